@@ -0,0 +1,466 @@
+#include "deformKernel.h"
+#include "fixedDegreeKernel.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define DEFORM_KERNEL_X86_64
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC/Clang compile the AVX2 path for its own function only, so the rest of the
+// project does not need -mavx2. MSVC always accepts the intrinsics.
+#if defined(__GNUC__) || defined(__clang__)
+#define DEFORM_KERNEL_TARGET(isa) __attribute__((target(isa)))
+#else
+#define DEFORM_KERNEL_TARGET(isa)
+#endif
+
+namespace {
+    // Largest span the vectorized paths keep on the stack. Larger lattices use the scalar path.
+    const int MAX_VECTOR_SPAN = 15;
+
+    /*
+    * Fills <out> with the binomial coefficients C(n, 0..n).
+    */
+    void binomial_row(int n, float* out) {
+        double coeff = 1.0;
+        for (int v = 0; v <= n; v++) {
+            out[v] = (float)coeff;
+            coeff = coeff * (n - v) / (v + 1);
+        }
+    }
+
+    /*
+    * The rows of FIXED_DEGREE_KERNEL::PASCAL_TRIANGLE the fixed-span kernels use,
+    * converted to float once at compile time.
+    */
+    struct FixedCoefficients {
+        float rows[FIXED_DEGREE_KERNEL::MAX_FIXED_SPAN + 1][FIXED_DEGREE_KERNEL::MAX_FIXED_SPAN + 1];
+
+        constexpr FixedCoefficients() : rows() {
+            for (int n = 0; n <= FIXED_DEGREE_KERNEL::MAX_FIXED_SPAN; n++) {
+                for (int k = 0; k <= n; k++) {
+                    rows[n][k] = (float)FIXED_DEGREE_KERNEL::PASCAL_TRIANGLE.rows[n][k];
+                }
+            }
+        }
+    };
+
+    constexpr FixedCoefficients FIXED_COEFFICIENTS;
+
+    /*
+    * Fills <out> with the Bernstein basis B_0..B_n(x) using running powers of x and (1 - x).
+    */
+    void basis_row(double x, int n, double* out) {
+        double power = 1.0;
+        for (int v = 0; v <= n; v++) {
+            out[v] = power;
+            power *= x;
+        }
+
+        double coeff = 1.0;
+        power = 1.0;
+        for (int v = n; v >= 0; v--) {
+            out[v] *= power * coeff;
+            power *= 1.0 - x;
+            coeff = coeff * v / (n - v + 1);
+        }
+    }
+
+#ifdef DEFORM_KERNEL_X86_64
+    /*
+    * 4-wide basis row. <coeff> holds C(n, 0..n).
+    */
+    inline void basis_row_sse(__m128 x, int n, const float* coeff, __m128* out) {
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 one_minus_x = _mm_sub_ps(one, x);
+
+        out[0] = one;
+        for (int v = 1; v <= n; v++) {
+            out[v] = _mm_mul_ps(out[v - 1], x);
+        }
+
+        __m128 power = one;
+        for (int v = n; v >= 0; v--) {
+            out[v] = _mm_mul_ps(_mm_mul_ps(out[v], power), _mm_set1_ps(coeff[v]));
+            power = _mm_mul_ps(power, one_minus_x);
+        }
+    }
+
+    /*
+    * SSE path. SSE2 is part of the x86-64 baseline so this needs no detection.
+    */
+    void deform_sse(const float* s, const float* t, const float* u, size_t count,
+        const std::vector<int>& spans, const LVecBase4f* control_points, LPoint3f* out) {
+        const int l = spans[0], m = spans[1], n = spans[2];
+
+        float coeff_s[MAX_VECTOR_SPAN + 1], coeff_t[MAX_VECTOR_SPAN + 1], coeff_u[MAX_VECTOR_SPAN + 1];
+        binomial_row(l, coeff_s);
+        binomial_row(m, coeff_t);
+        binomial_row(n, coeff_u);
+
+        __m128 basis_s[MAX_VECTOR_SPAN + 1], basis_t[MAX_VECTOR_SPAN + 1], basis_u[MAX_VECTOR_SPAN + 1];
+        alignas(16) float x_out[4], y_out[4], z_out[4];
+
+        size_t v = 0;
+        for (; v + 4 <= count; v += 4) {
+            basis_row_sse(_mm_loadu_ps(s + v), l, coeff_s, basis_s);
+            basis_row_sse(_mm_loadu_ps(t + v), m, coeff_t, basis_t);
+            basis_row_sse(_mm_loadu_ps(u + v), n, coeff_u, basis_u);
+
+            __m128 x = _mm_setzero_ps();
+            __m128 y = _mm_setzero_ps();
+            __m128 z = _mm_setzero_ps();
+
+            const LVecBase4f* point = control_points;
+            for (int i = 0; i <= l; i++) {
+                for (int j = 0; j <= m; j++) {
+                    __m128 weight_ij = _mm_mul_ps(basis_s[i], basis_t[j]);
+                    for (int k = 0; k <= n; k++) {
+                        __m128 weight = _mm_mul_ps(weight_ij, basis_u[k]);
+                        x = _mm_add_ps(x, _mm_mul_ps(weight, _mm_set1_ps((*point)[0])));
+                        y = _mm_add_ps(y, _mm_mul_ps(weight, _mm_set1_ps((*point)[1])));
+                        z = _mm_add_ps(z, _mm_mul_ps(weight, _mm_set1_ps((*point)[2])));
+                        point++;
+                    }
+                }
+            }
+
+            _mm_store_ps(x_out, x);
+            _mm_store_ps(y_out, y);
+            _mm_store_ps(z_out, z);
+            for (int lane = 0; lane < 4; lane++) {
+                out[v + lane].set(x_out[lane], y_out[lane], z_out[lane]);
+            }
+        }
+
+        DEFORM_KERNEL::deform_scalar(s + v, t + v, u + v, count - v, spans, control_points, out + v);
+    }
+
+    /*
+    * 8-wide basis row. <coeff> holds C(n, 0..n).
+    */
+    DEFORM_KERNEL_TARGET("avx2,fma")
+    inline void basis_row_avx2(__m256 x, int n, const float* coeff, __m256* out) {
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 one_minus_x = _mm256_sub_ps(one, x);
+
+        out[0] = one;
+        for (int v = 1; v <= n; v++) {
+            out[v] = _mm256_mul_ps(out[v - 1], x);
+        }
+
+        __m256 power = one;
+        for (int v = n; v >= 0; v--) {
+            out[v] = _mm256_mul_ps(_mm256_mul_ps(out[v], power), _mm256_set1_ps(coeff[v]));
+            power = _mm256_mul_ps(power, one_minus_x);
+        }
+    }
+
+    /*
+    * AVX2 + FMA path, 8 vertices per iteration.
+    */
+    DEFORM_KERNEL_TARGET("avx2,fma")
+    void deform_avx2(const float* s, const float* t, const float* u, size_t count,
+        const std::vector<int>& spans, const LVecBase4f* control_points, LPoint3f* out) {
+        const int l = spans[0], m = spans[1], n = spans[2];
+
+        float coeff_s[MAX_VECTOR_SPAN + 1], coeff_t[MAX_VECTOR_SPAN + 1], coeff_u[MAX_VECTOR_SPAN + 1];
+        binomial_row(l, coeff_s);
+        binomial_row(m, coeff_t);
+        binomial_row(n, coeff_u);
+
+        __m256 basis_s[MAX_VECTOR_SPAN + 1], basis_t[MAX_VECTOR_SPAN + 1], basis_u[MAX_VECTOR_SPAN + 1];
+        alignas(32) float x_out[8], y_out[8], z_out[8];
+
+        size_t v = 0;
+        for (; v + 8 <= count; v += 8) {
+            basis_row_avx2(_mm256_loadu_ps(s + v), l, coeff_s, basis_s);
+            basis_row_avx2(_mm256_loadu_ps(t + v), m, coeff_t, basis_t);
+            basis_row_avx2(_mm256_loadu_ps(u + v), n, coeff_u, basis_u);
+
+            __m256 x = _mm256_setzero_ps();
+            __m256 y = _mm256_setzero_ps();
+            __m256 z = _mm256_setzero_ps();
+
+            const LVecBase4f* point = control_points;
+            for (int i = 0; i <= l; i++) {
+                for (int j = 0; j <= m; j++) {
+                    __m256 weight_ij = _mm256_mul_ps(basis_s[i], basis_t[j]);
+                    for (int k = 0; k <= n; k++) {
+                        __m256 weight = _mm256_mul_ps(weight_ij, basis_u[k]);
+                        x = _mm256_fmadd_ps(weight, _mm256_set1_ps((*point)[0]), x);
+                        y = _mm256_fmadd_ps(weight, _mm256_set1_ps((*point)[1]), y);
+                        z = _mm256_fmadd_ps(weight, _mm256_set1_ps((*point)[2]), z);
+                        point++;
+                    }
+                }
+            }
+
+            _mm256_store_ps(x_out, x);
+            _mm256_store_ps(y_out, y);
+            _mm256_store_ps(z_out, z);
+            for (int lane = 0; lane < 8; lane++) {
+                out[v + lane].set(x_out[lane], y_out[lane], z_out[lane]);
+            }
+        }
+
+        deform_sse(s + v, t + v, u + v, count - v, spans, control_points, out + v);
+    }
+
+    /*
+    * SSE path specialized on the spans (L, M, N). The coefficients come from the
+    * compile-time Pascal triangle (FIXED_COEFFICIENTS) and every loop has a
+    * compile-time trip count, so the compiler unrolls it completely.
+    * The tail goes through the scalar FIXED_DEGREE_KERNEL of the same spans.
+    */
+    template<int L, int M, int N>
+    void deform_sse_fixed(const float* s, const float* t, const float* u, size_t count,
+        const LVecBase4f* control_points, LPoint3f* out) {
+        const float* coeff_s = FIXED_COEFFICIENTS.rows[L];
+        const float* coeff_t = FIXED_COEFFICIENTS.rows[M];
+        const float* coeff_u = FIXED_COEFFICIENTS.rows[N];
+
+        __m128 basis_s[L + 1], basis_t[M + 1], basis_u[N + 1];
+        alignas(16) float x_out[4], y_out[4], z_out[4];
+
+        size_t v = 0;
+        for (; v + 4 <= count; v += 4) {
+            basis_row_sse(_mm_loadu_ps(s + v), L, coeff_s, basis_s);
+            basis_row_sse(_mm_loadu_ps(t + v), M, coeff_t, basis_t);
+            basis_row_sse(_mm_loadu_ps(u + v), N, coeff_u, basis_u);
+
+            __m128 x = _mm_setzero_ps();
+            __m128 y = _mm_setzero_ps();
+            __m128 z = _mm_setzero_ps();
+
+            for (int i = 0; i <= L; i++) {
+                for (int j = 0; j <= M; j++) {
+                    __m128 weight_ij = _mm_mul_ps(basis_s[i], basis_t[j]);
+                    for (int k = 0; k <= N; k++) {
+                        const LVecBase4f& point = control_points[(i * (M + 1) + j) * (N + 1) + k];
+                        __m128 weight = _mm_mul_ps(weight_ij, basis_u[k]);
+                        x = _mm_add_ps(x, _mm_mul_ps(weight, _mm_set1_ps(point[0])));
+                        y = _mm_add_ps(y, _mm_mul_ps(weight, _mm_set1_ps(point[1])));
+                        z = _mm_add_ps(z, _mm_mul_ps(weight, _mm_set1_ps(point[2])));
+                    }
+                }
+            }
+
+            _mm_store_ps(x_out, x);
+            _mm_store_ps(y_out, y);
+            _mm_store_ps(z_out, z);
+            for (int lane = 0; lane < 4; lane++) {
+                out[v + lane].set(x_out[lane], y_out[lane], z_out[lane]);
+            }
+        }
+
+        FIXED_DEGREE_KERNEL::deform<L, M, N>(s + v, t + v, u + v, count - v, control_points, out + v);
+    }
+
+    /*
+    * AVX2 + FMA path specialized on the spans (L, M, N), see deform_sse_fixed.
+    */
+    template<int L, int M, int N>
+    DEFORM_KERNEL_TARGET("avx2,fma")
+    void deform_avx2_fixed(const float* s, const float* t, const float* u, size_t count,
+        const LVecBase4f* control_points, LPoint3f* out) {
+        const float* coeff_s = FIXED_COEFFICIENTS.rows[L];
+        const float* coeff_t = FIXED_COEFFICIENTS.rows[M];
+        const float* coeff_u = FIXED_COEFFICIENTS.rows[N];
+
+        __m256 basis_s[L + 1], basis_t[M + 1], basis_u[N + 1];
+        alignas(32) float x_out[8], y_out[8], z_out[8];
+
+        size_t v = 0;
+        for (; v + 8 <= count; v += 8) {
+            basis_row_avx2(_mm256_loadu_ps(s + v), L, coeff_s, basis_s);
+            basis_row_avx2(_mm256_loadu_ps(t + v), M, coeff_t, basis_t);
+            basis_row_avx2(_mm256_loadu_ps(u + v), N, coeff_u, basis_u);
+
+            __m256 x = _mm256_setzero_ps();
+            __m256 y = _mm256_setzero_ps();
+            __m256 z = _mm256_setzero_ps();
+
+            for (int i = 0; i <= L; i++) {
+                for (int j = 0; j <= M; j++) {
+                    __m256 weight_ij = _mm256_mul_ps(basis_s[i], basis_t[j]);
+                    for (int k = 0; k <= N; k++) {
+                        const LVecBase4f& point = control_points[(i * (M + 1) + j) * (N + 1) + k];
+                        __m256 weight = _mm256_mul_ps(weight_ij, basis_u[k]);
+                        x = _mm256_fmadd_ps(weight, _mm256_set1_ps(point[0]), x);
+                        y = _mm256_fmadd_ps(weight, _mm256_set1_ps(point[1]), y);
+                        z = _mm256_fmadd_ps(weight, _mm256_set1_ps(point[2]), z);
+                    }
+                }
+            }
+
+            _mm256_store_ps(x_out, x);
+            _mm256_store_ps(y_out, y);
+            _mm256_store_ps(z_out, z);
+            for (int lane = 0; lane < 8; lane++) {
+                out[v + lane].set(x_out[lane], y_out[lane], z_out[lane]);
+            }
+        }
+
+        deform_sse_fixed<L, M, N>(s + v, t + v, u + v, count - v, control_points, out + v);
+    }
+
+    typedef FIXED_DEGREE_KERNEL::Function KernelTable[FIXED_DEGREE_KERNEL::MAX_FIXED_SPAN + 1]
+        [FIXED_DEGREE_KERNEL::MAX_FIXED_SPAN + 1][FIXED_DEGREE_KERNEL::MAX_FIXED_SPAN + 1];
+
+    /*
+    * Instantiates the span-specialized SSE and AVX2 paths for every span combination
+    * FIXED_DEGREE_KERNEL covers.
+    */
+    struct FixedVectorKernels {
+        KernelTable sse, avx2;
+
+        FixedVectorKernels() {
+            using FIXED_DEGREE_KERNEL::Unroll;
+            const int end = FIXED_DEGREE_KERNEL::MAX_FIXED_SPAN + 1;
+
+            Unroll<0, end>::apply([&](auto l) {
+                Unroll<0, end>::apply([&](auto m) {
+                    Unroll<0, end>::apply([&](auto n) {
+                        const int L = decltype(l)::value, M = decltype(m)::value, N = decltype(n)::value;
+                        sse[L][M][N] = &deform_sse_fixed<L, M, N>;
+                        avx2[L][M][N] = &deform_avx2_fixed<L, M, N>;
+                    });
+                });
+            });
+        }
+    };
+
+    /*
+    * Returns the span-specialized vector path for <spans>, or nullptr if there isn't one.
+    */
+    FIXED_DEGREE_KERNEL::Function find_vector_kernel(bool avx2, const std::vector<int>& spans) {
+        static const FixedVectorKernels kernels;
+
+        if (FIXED_DEGREE_KERNEL::find_kernel(spans) == nullptr) {
+            return nullptr;
+        }
+        return (avx2 ? kernels.avx2 : kernels.sse)[spans[0]][spans[1]][spans[2]];
+    }
+
+    /*
+    * True if the CPU and OS both support AVX2 and FMA.
+    */
+    bool has_avx2() {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) {
+            return false;
+        }
+        __cpuid(info, 1);
+        bool fma = (info[2] & (1 << 12)) != 0;
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        if (!fma || !osxsave || (_xgetbv(0) & 0x6) != 0x6) {
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+    }
+#endif
+}
+
+/*
+* Returns the widest instruction set supported by this CPU. Detected once.
+*/
+DEFORM_KERNEL::InstructionSet DEFORM_KERNEL::get_best_instruction_set() {
+#ifdef DEFORM_KERNEL_X86_64
+    static const InstructionSet best = has_avx2() ? IS_avx2 : IS_sse;
+    return best;
+#else
+    return IS_scalar;
+#endif
+}
+
+/*
+* Returns a readable name for the given instruction set.
+*/
+const char* DEFORM_KERNEL::get_instruction_set_name(InstructionSet instruction_set) {
+    switch (instruction_set) {
+    case IS_avx2:
+        return "avx2";
+    case IS_sse:
+        return "sse";
+    default:
+        return "scalar";
+    }
+}
+
+/*
+* Deforms <count> vertices given by the s, t, u streams into <out> with the requested
+* instruction set. Falls back to narrower paths if it isn't available or if a span
+* is too large to be kept in registers. Every path prefers a degree-specialized
+* kernel (spans up to FIXED_DEGREE_KERNEL::MAX_FIXED_SPAN) and falls back to the
+* generic one.
+*/
+void DEFORM_KERNEL::deform(InstructionSet instruction_set, const float* s, const float* t, const float* u, size_t count,
+    const std::vector<int>& spans, const LVecBase4f* control_points, LPoint3f* out) {
+    bool fits = spans[0] <= MAX_VECTOR_SPAN && spans[1] <= MAX_VECTOR_SPAN && spans[2] <= MAX_VECTOR_SPAN;
+
+#ifdef DEFORM_KERNEL_X86_64
+    if (fits && instruction_set != IS_scalar) {
+        bool avx2 = instruction_set == IS_avx2 && get_best_instruction_set() == IS_avx2;
+        FIXED_DEGREE_KERNEL::Function fixed = find_vector_kernel(avx2, spans);
+        if (fixed != nullptr) {
+            fixed(s, t, u, count, control_points, out);
+        }
+        else if (avx2) {
+            deform_avx2(s, t, u, count, spans, control_points, out);
+        }
+        else {
+            deform_sse(s, t, u, count, spans, control_points, out);
+        }
+        return;
+    }
+#endif
+    FIXED_DEGREE_KERNEL::Function fixed = FIXED_DEGREE_KERNEL::find_kernel(spans);
+    if (fixed != nullptr) {
+        fixed(s, t, u, count, control_points, out);
+        return;
+    }
+    deform_scalar(s, t, u, count, spans, control_points, out);
+}
+
+/*
+* Generic scalar, double precision path. Same evaluation order as FreeFormDeform::deform_vertex.
+*/
+void DEFORM_KERNEL::deform_scalar(const float* s, const float* t, const float* u, size_t count,
+    const std::vector<int>& spans, const LVecBase4f* control_points, LPoint3f* out) {
+    const int l = spans[0], m = spans[1], n = spans[2];
+
+    std::vector<double> basis_s(l + 1), basis_t(m + 1), basis_u(n + 1);
+
+    for (size_t v = 0; v < count; v++) {
+        basis_row(s[v], l, basis_s.data());
+        basis_row(t[v], m, basis_t.data());
+        basis_row(u[v], n, basis_u.data());
+
+        double x = 0.0, y = 0.0, z = 0.0;
+        const LVecBase4f* point = control_points;
+        for (int i = 0; i <= l; i++) {
+            for (int j = 0; j <= m; j++) {
+                double weight_ij = basis_s[i] * basis_t[j];
+                for (int k = 0; k <= n; k++) {
+                    double weight = weight_ij * basis_u[k];
+                    x += weight * (*point)[0];
+                    y += weight * (*point)[1];
+                    z += weight * (*point)[2];
+                    point++;
+                }
+            }
+        }
+        out[v].set(x, y, z);
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef DEFORM_KERNEL_H
+#define DEFORM_KERNEL_H
+
+#include "lpoint3.h"
+#include "lvecBase4.h"
+
+#include <vector>
+
+// Batched evaluation of the Sederberg/Parry trivariate Bernstein map.
+// Vertices are given as structure-of-arrays s, t, u streams and positions are
+// written back in bulk. The vectorized paths evaluate 4 (SSE) or 8 (AVX2)
+// vertices at once; the instruction set is picked at runtime. Every path uses a
+// degree-specialized kernel (see fixedDegreeKernel.h) when the spans have one.
+namespace DEFORM_KERNEL {
+    enum InstructionSet {
+        IS_scalar,
+        IS_sse,
+        IS_avx2,
+    };
+
+    InstructionSet get_best_instruction_set();
+    const char* get_instruction_set_name(InstructionSet instruction_set);
+
+    void deform(InstructionSet instruction_set, const float* s, const float* t, const float* u, size_t count,
+        const std::vector<int>& spans, const LVecBase4f* control_points, LPoint3f* out);
+
+    void deform_scalar(const float* s, const float* t, const float* u, size_t count,
+        const std::vector<int>& spans, const LVecBase4f* control_points, LPoint3f* out);
+}
+
+#endif
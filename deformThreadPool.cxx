@@ -0,0 +1,228 @@
+#include "deformThreadPool.h"
+
+#include <algorithm>
+
+DeformThreadPool* DeformThreadPool::_global_ptr = nullptr;
+
+/*
+* Initializer for DeformThreadPool. num_threads includes the calling thread;
+* 0 uses get_default_num_threads. No thread is spawned until it is needed.
+*/
+DeformThreadPool::DeformThreadPool(int num_threads) {
+    configure(num_threads);
+}
+
+/*
+* Deconstructor for DeformThreadPool. Joins every worker.
+*/
+DeformThreadPool::~DeformThreadPool() {
+    stop();
+}
+
+/*
+* Returns the number of hardware threads, or 1 if unknown.
+*/
+int DeformThreadPool::get_default_num_threads() {
+    unsigned int count = std::thread::hardware_concurrency();
+    return count == 0 ? 1 : (int)count;
+}
+
+/*
+* Returns the pool shared by every FreeFormDeform, so the number of threads
+* doesn't grow with the number of deformers.
+*/
+DeformThreadPool* DeformThreadPool::get_global_ptr() {
+    static std::once_flag created;
+    std::call_once(created, [] {
+        _global_ptr = new DeformThreadPool();
+    });
+    return _global_ptr;
+}
+
+/*
+* Resizes the pool to the given number of threads (including the caller).
+* Workers are joined now and respawned by the next run that needs them.
+*/
+void DeformThreadPool::set_num_threads(int num_threads) {
+    std::lock_guard<std::mutex> run_guard(_run_lock);
+    stop();
+    configure(num_threads);
+}
+
+/*
+* Sets up the queues for num_threads workers without spawning them.
+*/
+void DeformThreadPool::configure(int num_threads) {
+    if (num_threads <= 0) {
+        num_threads = get_default_num_threads();
+    }
+    _num_threads = num_threads;
+
+    _queues.clear();
+    for (int i = 0; i < _num_threads; i++) {
+        _queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+    }
+}
+
+/*
+* Spawns the num_threads - 1 workers if they aren't running. The caller of run()
+* is worker 0. Requires _run_lock.
+*/
+void DeformThreadPool::start() {
+    if (!_threads.empty()) {
+        return;
+    }
+
+    size_t generation;
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _stopping = false;
+        generation = _generation;
+    }
+    for (int i = 1; i < _num_threads; i++) {
+        _threads.push_back(std::thread(&DeformThreadPool::worker_loop, this, i, generation));
+    }
+}
+
+/*
+* Signals every worker to exit and joins them.
+*/
+void DeformThreadPool::stop() {
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _stopping = true;
+    }
+    _wake.notify_all();
+
+    for (std::thread& thread : _threads) {
+        thread.join();
+    }
+    _threads.clear();
+}
+
+/*
+* Runs function(task, worker) for every task in [0, num_tasks) and blocks until all
+* of them have finished. Tasks are dealt round-robin to the worker queues up front;
+* load imbalance is then evened out by stealing.
+*
+* If another thread is using the workers, the tasks run on the calling thread as
+* worker 0 rather than queueing up behind it (or oversubscribing the CPU).
+*
+* <max_workers> (if positive) caps how many workers, including the caller, take part,
+* so one user can run on fewer threads without resizing the pool for everyone.
+*/
+void DeformThreadPool::run(size_t num_tasks, const TaskFunction& function, int max_workers) {
+    if (num_tasks == 0) {
+        return;
+    }
+
+    // Nothing to share, or the workers are busy: stay on this thread.
+    std::unique_lock<std::mutex> run_guard(_run_lock, std::try_to_lock);
+    int num_workers = max_workers > 0 ? std::min(max_workers, _num_threads) : _num_threads;
+    if (!run_guard.owns_lock() || num_workers == 1 || num_tasks == 1) {
+        for (size_t i = 0; i < num_tasks; i++) {
+            function(i, 0);
+        }
+        return;
+    }
+    start();
+
+    // The batch is complete before any task of it can be popped: the function and
+    // count come first, and each task is pushed under its queue's lock.
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _function = &function;
+        _remaining = num_tasks;
+        _num_workers = num_workers;
+        _generation++;
+        for (size_t i = 0; i < num_tasks; i++) {
+            WorkerQueue& queue = *_queues[i % num_workers];
+            std::lock_guard<std::mutex> queue_guard(queue.lock);
+            queue.tasks.push_back(i);
+        }
+    }
+    _wake.notify_all();
+
+    process(0);
+
+    // Join: every task is done and no worker is still looking at the queues.
+    std::unique_lock<std::mutex> guard(_lock);
+    _done.wait(guard, [this] { return _remaining == 0 && _active == 0; });
+    _function = nullptr;
+}
+
+/*
+* Background worker. Sleeps until run() publishes a generation of tasks past <generation>.
+*
+* A worker only joins the generation still in flight when it takes _lock: one that
+* woke too late for a batch that has since finished skips it, and run() doesn't
+* return (so no other batch starts) while a worker that joined is still popping.
+*/
+void DeformThreadPool::worker_loop(int worker, size_t generation) {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(_lock);
+            _wake.wait(guard, [&] { return _stopping || _generation != generation; });
+            if (_stopping) {
+                return;
+            }
+            generation = _generation;
+            if (_function == nullptr) {
+                continue;
+            }
+            _active++;
+        }
+
+        process(worker);
+
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _active--;
+        }
+        _done.notify_all();
+    }
+}
+
+/*
+* Executes tasks until every queue is empty.
+*/
+void DeformThreadPool::process(int worker) {
+    size_t task;
+    while (pop_task(worker, task)) {
+        (*_function)(task, worker);
+        if (--_remaining == 0) {
+            std::lock_guard<std::mutex> guard(_lock);
+            _done.notify_all();
+        }
+    }
+}
+
+/*
+* Pops from the front of our own queue, otherwise steals from the back of another.
+* Workers past the cap of the current run() get nothing.
+*/
+bool DeformThreadPool::pop_task(int worker, size_t& task) {
+    if (worker >= _num_workers) {
+        return false;
+    }
+    {
+        WorkerQueue& queue = *_queues[worker];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (!queue.tasks.empty()) {
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+            return true;
+        }
+    }
+
+    for (int i = 1; i < _num_workers; i++) {
+        WorkerQueue& victim = *_queues[(worker + i) % _num_workers];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
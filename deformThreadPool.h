@@ -0,0 +1,75 @@
+#ifndef DEFORM_THREAD_POOL_H
+#define DEFORM_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+* Fixed-size pool used to split deformation work into chunks.
+* Every worker owns a deque of task indices; idle workers steal from the back
+* of the others. The calling thread takes part as worker 0 and run() only
+* returns once every task has finished.
+*
+* Threads are only spawned by the first run() that has work to share. One pool is
+* shared process-wide (see get_global_ptr); while it is busy, other callers run
+* their tasks on their own thread instead of waiting for it.
+*/
+class DeformThreadPool {
+public:
+    // (task index, worker index)
+    typedef std::function<void(size_t, int)> TaskFunction;
+
+    DeformThreadPool(int num_threads = 0);
+    ~DeformThreadPool();
+
+    void set_num_threads(int num_threads);
+    inline int get_num_threads() const;
+
+    void run(size_t num_tasks, const TaskFunction& function, int max_workers = 0);
+
+    static int get_default_num_threads();
+    static DeformThreadPool* get_global_ptr();
+
+private:
+    void configure(int num_threads);
+    void start();
+    void stop();
+    void worker_loop(int worker, size_t generation);
+    void process(int worker);
+    bool pop_task(int worker, size_t& task);
+
+    struct WorkerQueue {
+        std::mutex lock;
+        std::deque<size_t> tasks;
+    };
+
+    int _num_threads = 1;
+    std::vector<std::thread> _threads;
+    std::vector<std::unique_ptr<WorkerQueue>> _queues;
+
+    // Held by the run() using the workers, and while they are reconfigured.
+    std::mutex _run_lock;
+
+    std::mutex _lock;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+
+    const TaskFunction* _function = nullptr;
+    int _num_workers = 1; // Workers taking part in the current run().
+    std::atomic<size_t> _remaining{ 0 };
+    size_t _generation = 0;
+    int _active = 0;
+    bool _stopping = false;
+
+    static DeformThreadPool* _global_ptr;
+};
+
+#include "deformThreadPool.I"
+
+#endif
@@ -0,0 +1,24 @@
+#include "deformationGrid.h"
+
+/*
+* Fills s, t, u with the parameters of every sample, in sample order.
+* Evaluate the FFD map at these and write the results into modify_samples.
+*/
+void DeformationGrid::get_sample_parameters(pvector<float>& s, pvector<float>& t, pvector<float>& u) const {
+    s.resize(get_num_samples());
+    t.resize(get_num_samples());
+    u.resize(get_num_samples());
+
+    float step = 1.0f / (_resolution - 1);
+    size_t index = 0;
+    for (int i = 0; i < _resolution; i++) {
+        for (int j = 0; j < _resolution; j++) {
+            for (int k = 0; k < _resolution; k++) {
+                s[index] = i * step;
+                t[index] = j * step;
+                u[index] = k * step;
+                index++;
+            }
+        }
+    }
+}
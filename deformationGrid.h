@@ -0,0 +1,38 @@
+#ifndef DEFORMATION_GRID_H
+#define DEFORMATION_GRID_H
+
+#include "lpoint3.h"
+#include "pvector.h"
+
+/*
+* Regular grid of samples of the FFD map over (s,t,u) space in [0, 1]^3.
+* Once the samples are evaluated for the current control points, any vertex is
+* approximated by trilinear interpolation of its cell's eight samples, no matter
+* how many control points the lattice has.
+*/
+class DeformationGrid {
+public:
+    inline DeformationGrid();
+
+    inline void set_resolution(int resolution);
+    inline int get_resolution() const;
+    inline size_t get_num_samples() const;
+
+    void get_sample_parameters(pvector<float>& s, pvector<float>& t, pvector<float>& u) const;
+    inline pvector<LPoint3f>& modify_samples();
+
+    inline LPoint3f sample(float s, float t, float u) const;
+
+private:
+    inline float locate(float x, int& cell) const;
+
+    // Samples per axis (>= 2).
+    int _resolution = 32;
+
+    // (i * _resolution + j) * _resolution + k -> FFD(i, j, k / (_resolution - 1))
+    pvector<LPoint3f> _samples;
+};
+
+#include "deformationGrid.I"
+
+#endif
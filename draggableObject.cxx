@@ -200,3 +200,18 @@ std::string DraggableObject::get_tag() const {
 bool DraggableObject::has_selected() const {
     return _selected.size() > 0;
 }
+
+/*
+* Enables or disables picking: while disabled, clicks pass through this object's
+* nodes as if it weren't registered. Nothing already selected is deselected.
+*/
+void DraggableObject::set_enabled(bool enabled) {
+    _enabled = enabled;
+}
+
+/*
+* Returns false if picking was disabled by set_enabled.
+*/
+bool DraggableObject::is_enabled() const {
+    return _enabled;
+}
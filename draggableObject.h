@@ -20,6 +20,9 @@ public:
     pvector<NodePath> get_selected();
     bool has_selected() const;
 
+    void set_enabled(bool enabled);
+    bool is_enabled() const;
+
     virtual void select(NodePath& np);
     virtual void deselect(NodePath& np);
     void deselect();
@@ -33,6 +36,7 @@ private:
     int _traverse_num;
     std::string _tag;
     std::string _event_name;
+    bool _enabled = true;
 
     pvector<NodePath> _nodes;
     pvector<NodePath> _selected;
@@ -161,7 +161,7 @@ void DraggableObjectManager::click() {
 
     // Check to see if we have any of special tags:
     for (std::unordered_map<std::string, DraggableObject*>::iterator it = _tag_map.begin(); it != _tag_map.end(); it++) {
-        if (into_np.has_net_tag(it->first)) {
+        if (it->second->is_enabled() && into_np.has_net_tag(it->first)) {
             draggable = it->second;
             draggable->select(into_np);
 
@@ -173,7 +173,7 @@ void DraggableObjectManager::click() {
     // If we made is this far, that means that we didn't have a tag match.
     // Let's compare directly to our managed objects.
     for (DraggableObject* draggable : _objects) {
-        if (draggable->has_node(into_np)) {
+        if (draggable->is_enabled() && draggable->has_node(into_np)) {
             draggable->select(into_np);
             object_handles->add_node_path(into_np);
             return;
@@ -190,6 +190,9 @@ void DraggableObjectManager::click() {
 
     NodePath& ancestor = into_np;
     for (DraggableObject* draggable : _objects) {
+        if (!draggable->is_enabled()) {
+            continue;
+        }
         // We confirmed that we weren't into_np. Traverse up.
         for (size_t i = 0; i < into_np.get_num_nodes()-1; i++) {
             ancestor = into_np.get_ancestor(i);
@@ -0,0 +1,42 @@
+#include "fixedDegreeKernel.h"
+
+namespace {
+    typedef FIXED_DEGREE_KERNEL::Function KernelTable[FIXED_DEGREE_KERNEL::MAX_FIXED_SPAN + 1]
+        [FIXED_DEGREE_KERNEL::MAX_FIXED_SPAN + 1][FIXED_DEGREE_KERNEL::MAX_FIXED_SPAN + 1];
+
+    /*
+    * Instantiates FIXED_DEGREE_KERNEL::deform for every span combination in [0, MAX_FIXED_SPAN].
+    * A span of 0 is a flat (bivariate) lattice; its loop unrolls away entirely.
+    */
+    struct FixedKernels {
+        KernelTable table;
+
+        FixedKernels() {
+            using FIXED_DEGREE_KERNEL::Unroll;
+            const int end = FIXED_DEGREE_KERNEL::MAX_FIXED_SPAN + 1;
+
+            Unroll<0, end>::apply([&](auto l) {
+                Unroll<0, end>::apply([&](auto m) {
+                    Unroll<0, end>::apply([&](auto n) {
+                        table[l][m][n] = &FIXED_DEGREE_KERNEL::deform<
+                            decltype(l)::value, decltype(m)::value, decltype(n)::value>;
+                    });
+                });
+            });
+        }
+    };
+}
+
+/*
+* Returns the kernel specialized on <spans>, or nullptr if there isn't one.
+*/
+FIXED_DEGREE_KERNEL::Function FIXED_DEGREE_KERNEL::find_kernel(const std::vector<int>& spans) {
+    static const FixedKernels kernels;
+
+    for (int axis = 0; axis < 3; axis++) {
+        if (spans[axis] < 0 || spans[axis] > MAX_FIXED_SPAN) {
+            return nullptr;
+        }
+    }
+    return kernels.table[spans[0]][spans[1]][spans[2]];
+}
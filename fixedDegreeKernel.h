@@ -0,0 +1,73 @@
+#ifndef FIXED_DEGREE_KERNEL_H
+#define FIXED_DEGREE_KERNEL_H
+
+#include "lpoint3.h"
+#include "lvecBase4.h"
+
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// Deformation kernels specialized on the lattice spans (l, m, n).
+// Bernstein coefficients come from a constexpr Pascal triangle and every
+// i/j/k loop is unrolled at compile time, so control point indices are
+// constants. find_kernel returns nullptr for spans without a specialization.
+namespace FIXED_DEGREE_KERNEL {
+    // Largest span with a specialized kernel (0x0x0 through 4x4x4; 0 is a flat axis).
+    const int MAX_FIXED_SPAN = 4;
+
+    // Largest span whose binomial coefficients all fit in 64 bits. C(68, 34) does not.
+    const int MAX_EXACT_SPAN = 67;
+
+    /*
+    * Pascal's triangle up to MAX_EXACT_SPAN, built at compile time by addition only.
+    */
+    struct PascalTriangle {
+        uint64_t rows[MAX_EXACT_SPAN + 1][MAX_EXACT_SPAN + 1];
+
+        constexpr PascalTriangle() : rows() {
+            for (int n = 0; n <= MAX_EXACT_SPAN; n++) {
+                rows[n][0] = 1;
+                for (int k = 1; k <= n; k++) {
+                    rows[n][k] = rows[n - 1][k - 1] + (k < n ? rows[n - 1][k] : 0);
+                }
+            }
+        }
+    };
+
+    constexpr PascalTriangle PASCAL_TRIANGLE;
+
+    constexpr uint64_t binomial(int n, int k);
+
+    /*
+    * Calls f(std::integral_constant<int, I>) for I in [BEGIN, END).
+    * The loop index stays a compile-time constant inside f.
+    */
+    template<int BEGIN, int END>
+    struct Unroll {
+        template<class Function>
+        static inline void apply(Function&& f);
+    };
+
+    template<int END>
+    struct Unroll<END, END> {
+        template<class Function>
+        static inline void apply(Function&&) {}
+    };
+
+    template<int N>
+    inline void basis_row(double x, double* out);
+
+    template<int L, int M, int N>
+    void deform(const float* s, const float* t, const float* u, size_t count,
+        const LVecBase4f* control_points, LPoint3f* out);
+
+    typedef void (*Function)(const float* s, const float* t, const float* u, size_t count,
+        const LVecBase4f* control_points, LPoint3f* out);
+
+    Function find_kernel(const std::vector<int>& spans);
+}
+
+#include "fixedDegreeKernel.I"
+
+#endif
@@ -1,42 +1,410 @@
 #include "freeFormDeform.h"
-#include <unordered_set>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+namespace {
+    // True if <a> and <b> move no point within <extent> of the origin further apart
+    // than <tolerance>: the upper 3x3 is weighted by the extent, the translation isn't.
+    bool almost_same_transform(const LMatrix4f& a, const LMatrix4f& b, float extent, float tolerance) {
+        for (int r = 0; r < 4; r++) {
+            float scale = r < 3 ? extent : 1.0f;
+            for (int c = 0; c < 3; c++) {
+                if (fabs(a(r, c) - b(r, c)) * scale > tolerance) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // True if every point of <a> is within <tolerance> of the same point of <b>, per component.
+    bool almost_same_points(const pvector<LVecBase4f>& a, const pvector<LVecBase4f>& b, float tolerance) {
+        if (a.size() != b.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); i++) {
+            for (int c = 0; c < 3; c++) {
+                if (fabs(a[i][c] - b[i][c]) > tolerance) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Exact bits of a rest position; -0 and +0 weld together.
+    struct PositionKey {
+        uint32_t bits[3];
+
+        PositionKey(const LPoint3f& point) {
+            for (int axis = 0; axis < 3; axis++) {
+                float component = point[axis] + 0.0f;
+                memcpy(&bits[axis], &component, sizeof(float));
+            }
+        }
+
+        bool operator==(const PositionKey& other) const {
+            return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+        }
+    };
+
+    struct PositionKeyHash {
+        size_t operator()(const PositionKey& key) const {
+            size_t hash = key.bits[0];
+            hash = hash * 0x9e3779b1u ^ key.bits[1];
+            hash = hash * 0x9e3779b1u ^ key.bits[2];
+            return hash;
+        }
+    };
+
+    // Eigenvectors of the symmetric 3x3 <matrix> into the rows of <axes>, by descending
+    // eigenvalue. Cyclic Jacobi rotations; converges in a handful of sweeps.
+    void principal_axes(const double matrix[3][3], double axes[3][3]) {
+        double a[3][3], v[3][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+        memcpy(a, matrix, sizeof(a));
+
+        for (int sweep = 0; sweep < 32; sweep++) {
+            double off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+            if (off < 1e-24 * (a[0][0] * a[0][0] + a[1][1] * a[1][1] + a[2][2] * a[2][2]) || off == 0.0) {
+                break;
+            }
+            for (int p = 0; p < 2; p++) {
+                for (int q = p + 1; q < 3; q++) {
+                    if (a[p][q] == 0.0) {
+                        continue;
+                    }
+                    double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+                    double t = (theta >= 0.0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+                    double c = 1.0 / sqrt(t * t + 1.0);
+                    double s = t * c;
+
+                    // A <- J^T A J, V <- V J:
+                    for (int k = 0; k < 3; k++) {
+                        double akp = a[k][p], akq = a[k][q];
+                        a[k][p] = c * akp - s * akq;
+                        a[k][q] = s * akp + c * akq;
+                    }
+                    for (int k = 0; k < 3; k++) {
+                        double apk = a[p][k], aqk = a[q][k];
+                        a[p][k] = c * apk - s * aqk;
+                        a[q][k] = s * apk + c * aqk;
+                    }
+                    for (int k = 0; k < 3; k++) {
+                        double vkp = v[k][p], vkq = v[k][q];
+                        v[k][p] = c * vkp - s * vkq;
+                        v[k][q] = s * vkp + c * vkq;
+                    }
+                }
+            }
+        }
+
+        int order[3] = { 0, 1, 2 };
+        std::sort(order, order + 3, [&](int i, int j) { return a[i][i] > a[j][j]; });
+        for (int r = 0; r < 3; r++) {
+            for (int k = 0; k < 3; k++) {
+                axes[r][k] = v[k][order[r]];
+            }
+        }
+    }
+
+    // Spreads the low 10 bits of <x> three bits apart.
+    uint32_t spread_bits(uint32_t x) {
+        x &= 0x3ff;
+        x = (x | (x << 16)) & 0x030000ff;
+        x = (x | (x << 8)) & 0x0300f00f;
+        x = (x | (x << 4)) & 0x030c30c3;
+        x = (x | (x << 2)) & 0x09249249;
+        return x;
+    }
+
+    // 30-bit Morton (Z-order) key of an (s,t,u) clamped to the lattice.
+    uint32_t morton_key(float s, float t, float u) {
+        uint32_t cells[3];
+        float stu[3] = { s, t, u };
+        for (int axis = 0; axis < 3; axis++) {
+            float x = std::min(std::max(stu[axis], 0.0f), 1.0f);
+            cells[axis] = (uint32_t)(x * 1023.0f + 0.5f);
+        }
+        return spread_bits(cells[0]) | (spread_bits(cells[1]) << 1) | (spread_bits(cells[2]) << 2);
+    }
+}
+
+int FreeFormDeform::_next_bind_id = 0;
 
 /*
 * Initializer for FreeFormDeform. NodePath is the object wanting to deform.
 * Automatically contructs the Lattice and calls hook_drag_event on it
 * with an internal FFD_DRAG_EVENT event.
+*
+* With <async>, the NodePath is bound on the threaded "FreeFormDeform-bind" task chain
+* (shared by every instance, so many deformers load concurrently) and the constructor
+* returns right away. The lattice is visible but can't be picked until is_ready();
+* get_ready_event is thrown when it is. Anything else must wait for it (wait_ready).
 */
-FreeFormDeform::FreeFormDeform(NodePath np, NodePath render) {
+FreeFormDeform::FreeFormDeform(NodePath np, NodePath render, bool async) {
     _np = np;
     _geom_node_collection = _np.find_all_matches("**/+GeomNode");
     _top_node = _np.get_top();
     _render = render;
 
+    _parameter_mat = LMatrix4f::ident_mat();
+    _rest_frame = LMatrix4f::ident_mat();
+    _thread_pool = DeformThreadPool::get_global_ptr();
+    _grid.get_sample_parameters(_grid_parameters.s, _grid_parameters.t, _grid_parameters.u);
+
     _lattice = new Lattice(_np);
     _lattice->reparent_to(_render);
     _lattice->hook_drag_event("FFD_DRAG_EVENT", handle_drag, this);
 
     populate_lookup_table();
-    process_node();
+    if (!async) {
+        process_node();
+        return;
+    }
+
+    // Everything touching the scene graph happens here, on the App thread; the task
+    // only reads and writes vertex data. The lattice can't be picked until it's done.
+    _lattice->set_enabled(false);
+    _bound_lattice_mat = _lattice->get_mat(_np);
+    _lattice->calculate_lattice_vec();
+    capture_default_vertices();
+
+    // Each bind already spreads over the shared DeformThreadPool, so the chain only
+    // needs one thread; more would just compete with the pool's workers.
+    AsyncTaskManager* task_mgr = AsyncTaskManager::get_global_ptr();
+    AsyncTaskChain* chain = task_mgr->make_task_chain("FreeFormDeform-bind");
+    if (chain->get_num_threads() == 0) {
+        chain->set_num_threads(1);
+    }
+
+    _ready_event = "FFD_READY_EVENT_" + std::to_string(_next_bind_id++);
+    EventHandler::get_global_event_handler()->add_hook(_ready_event, handle_ready, this);
+
+    _bind_task = new GenericAsyncTask("FFD_BindTask", &bind_task, this);
+    _bind_task->set_task_chain("FreeFormDeform-bind");
+    _bind_task->set_done_event(_ready_event);
+    task_mgr->add(_bind_task);
 }
 
 /*
-* See also: freeFormDeform.I (berstein)
-* Computes the binomial_coeff between two variables:
+* Task binding the NodePath of an asynchronously constructed FreeFormDeform.
+* The scene graph side was captured by the constructor.
+*/
+AsyncTask::DoneStatus FreeFormDeform::bind_task(GenericAsyncTask*, void* args) {
+    FreeFormDeform* ffd = (FreeFormDeform*)args;
+    ffd->bind_vertices();
+    return AsyncTask::DoneStatus::DS_done;
+}
+
+/*
+* Queues settle_task, or postpones it if it's already waiting.
+*/
+void FreeFormDeform::schedule_settle() {
+    _moved_since_settle = true;
+    if (_settle_task != nullptr && _settle_task->is_alive()) {
+        return;
+    }
+    _moved_since_settle = false;
+    _settle_task = new GenericAsyncTask("FFD_SettleTask", &settle_task, this);
+    _settle_task->set_delay(_SETTLE_DELAY);
+    AsyncTaskManager::get_global_ptr()->add(_settle_task);
+}
+
+/*
+* Rebinds after the model moved relative to the lattice, once no further move came
+* in for _SETTLE_DELAY: s,t,u through the rest frame at its new place, then weights
+* and influence, then every vertex. Runs on the App thread.
+*/
+AsyncTask::DoneStatus FreeFormDeform::settle_task(GenericAsyncTask*, void* data) {
+    FreeFormDeform* ffd = (FreeFormDeform*)data;
+
+    // Still moving; check again after another delay.
+    if (ffd->_moved_since_settle) {
+        ffd->_moved_since_settle = false;
+        return AsyncTask::DoneStatus::DS_again;
+    }
+
+    if (ffd->_reparameterize_pending) {
+        ffd->compose_parameterization();
+        ffd->reparameterize();
+        ffd->classify_points();
+        ffd->update_vertices(true);
+    }
+    return AsyncTask::DoneStatus::DS_done;
+}
+
+/*
+* Handles the ready event of an asynchronous bind: the lattice can be edited now.
+*/
+void FreeFormDeform::handle_ready(const Event*, void* args) {
+    FreeFormDeform* ffd = (FreeFormDeform*)args;
+    ffd->_lattice->set_enabled(true);
+}
+
+/*
+* See also: freeFormDeform.I (bernstein_row)
+* Computes the binomial coefficient between two variables:
 *   n: every edge span
 *   v: range: [0, n]
+* Coefficients are read from the compile-time Pascal triangle, so they're exact.
 */
 void FreeFormDeform::populate_lookup_table() {
     _v_n_comb_table.clear();
     for (int& span : _lattice->get_edge_spans()) { // ijk range = 0->span
-        std::vector<int> table;
+        std::vector<uint64_t> table;
         for (int i = 0; i <= span; i++) {
-            table.push_back(binomial_coeff(span, i));
+            table.push_back(FIXED_DEGREE_KERNEL::binomial(span, i));
         }
         _v_n_comb_table.push_back(table);
     }
 }
 
+/*
+* Caches the tensor-product basis weights of every captured vertex.
+* (s,t,u) only change when the lattice is rebuilt or the model settles at a new
+* place relative to it, so that's when the weights are rebuilt. Zero weights are skipped.
+*
+* Only the control points of the cell neighbourhood a vertex falls into (see
+* basis_support) are visited, with their indices computed directly.
+* Rows are weighted in chunks on the thread pool, then concatenated per binding.
+* Auto-tuning (see set_auto_tune) follows unless <retune> is false.
+*/
+void FreeFormDeform::build_weights(bool retune) {
+    _weight_error = 0.0;
+
+    int num_control_points = _lattice->get_num_control_points();
+    std::vector<int>& spans = _lattice->get_edge_spans();
+
+    // Most control points a single vertex can reach:
+    bool bspline = _lattice->get_basis_type() == Lattice::BT_bspline;
+    size_t max_support = 1;
+    for (int axis = 0; axis < 3; axis++) {
+        max_support *= bspline ? std::min(spans[axis] + 1, 4) : spans[axis] + 1;
+    }
+
+    // A control point can move a vertex by at most its weight times the lattice diagonal.
+    double extent = get_lattice_extent();
+
+    // Rows are weighted in chunks of (binding, first row), each into its own matrix,
+    // so a single large binding still spreads over every worker:
+    pvector<std::pair<size_t, size_t>> chunks;
+    pvector<size_t> binding_chunks(_bindings.size() + 1, 0);
+    for (size_t i = 0; i < _bindings.size(); i++) {
+        size_t num_rows = _bindings[i].default_vertices.parameters.s.size();
+        for (size_t begin = 0; begin < num_rows; begin += _DEFORM_CHUNK_SIZE) {
+            chunks.push_back(std::make_pair(i, begin));
+        }
+        binding_chunks[i + 1] = chunks.size();
+    }
+    pvector<WeightMatrix> chunk_weights(chunks.size());
+
+    // Largest pruning error of each chunk, reduced once every chunk is done:
+    pvector<double> chunk_errors(chunks.size(), 0.0);
+
+    run_tasks(chunks.size(), [&](size_t chunk, int) {
+        const ParameterStreams& parameters = _bindings[chunks[chunk].first].default_vertices.parameters;
+        size_t begin_row = chunks[chunk].second;
+        size_t end_row = std::min(begin_row + _DEFORM_CHUNK_SIZE, parameters.s.size());
+
+        pvector<double> rows[3];
+        pvector<std::pair<int, double>> vertex_weights;
+        vertex_weights.reserve(max_support);
+
+        WeightMatrix& weights = chunk_weights[chunk];
+        weights.reserve(end_row - begin_row, (end_row - begin_row) * max_support);
+
+        for (size_t row = begin_row; row < end_row; row++) {
+            LPoint3f stu(parameters.s[row], parameters.t[row], parameters.u[row]);
+            basis_rows(stu, rows);
+
+            int begin[3], end[3];
+            for (int axis = 0; axis < 3; axis++) {
+                basis_support(axis, stu[axis], begin[axis], end[axis]);
+            }
+
+            // Evaluate:
+            double largest = 0.0;
+            vertex_weights.clear();
+            for (int i = begin[0]; i <= end[0]; i++) {
+                for (int j = begin[1]; j <= end[1]; j++) {
+                    int ctrl_i = get_point_index(i, j, begin[2]);
+                    for (int k = begin[2]; k <= end[2]; k++, ctrl_i++) {
+                        double weight = rows[0][i] * rows[1][j] * rows[2][k];
+                        vertex_weights.push_back(std::make_pair(ctrl_i, weight));
+                        largest = std::max(largest, fabs(weight));
+                    }
+                }
+            }
+
+            // The largest weight always stays, so no row is pruned empty and every
+            // point remains either influenced or reset. Then sum up what's dropped:
+            double tolerance = std::min(_weight_tolerance, largest);
+            double kept = 0.0, kept_abs = 0.0, dropped_abs = 0.0;
+            for (std::pair<int, double>& vertex_weight : vertex_weights) {
+                double weight = vertex_weight.second;
+                if (fabs(weight) < tolerance) {
+                    dropped_abs += fabs(weight);
+                }
+                else {
+                    kept += weight;
+                    kept_abs += fabs(weight);
+                }
+            }
+
+            // Renormalize so the kept weights still sum to one (affine invariance).
+            double scale = 1.0;
+            if (dropped_abs > 0.0) {
+                double error = dropped_abs * extent;
+                if (kept != 0.0) {
+                    scale = 1.0 / kept;
+                    error += fabs(kept - 1.0) / fabs(kept) * kept_abs * extent;
+                }
+                chunk_errors[chunk] = std::max(chunk_errors[chunk], error);
+            }
+
+            weights.begin_row();
+            for (std::pair<int, double>& vertex_weight : vertex_weights) {
+                double weight = vertex_weight.second;
+                if (weight != 0.0 && fabs(weight) >= tolerance) {
+                    weights.push_weight(vertex_weight.first, weight * scale);
+                }
+            }
+        }
+    });
+
+    // Then each binding concatenates its chunks, in row order:
+    run_tasks(_bindings.size(), [&](size_t b, int) {
+        size_t num_rows = 0, num_weights = 0;
+        for (size_t chunk = binding_chunks[b]; chunk < binding_chunks[b + 1]; chunk++) {
+            num_rows += chunk_weights[chunk].get_num_rows();
+            num_weights += chunk_weights[chunk].get_num_weights();
+        }
+
+        WeightMatrix& weights = _bindings[b].weights;
+        weights.clear();
+        weights.reserve(num_rows, num_weights);
+        for (size_t chunk = binding_chunks[b]; chunk < binding_chunks[b + 1]; chunk++) {
+            weights.append(chunk_weights[chunk]);
+            chunk_weights[chunk].clear();
+        }
+        weights.build_columns(num_control_points);
+    });
+
+    for (double error : chunk_errors) {
+        _weight_error = std::max(_weight_error, error);
+    }
+
+    // The influence index is built from these weights:
+    _binding_dirty = true;
+    _deformation_stale = true;
+
+    if (_auto_tune && retune) {
+        tune();
+    }
+}
+
 /*
 * The drag event for which we hook Lattice onto.
 *
@@ -46,148 +414,737 @@ void FreeFormDeform::populate_lookup_table() {
 */
 void FreeFormDeform::handle_drag(const Event* e, void* args) {
     FreeFormDeform* ffd = (FreeFormDeform*)args;
+
+    // Still binding in the background:
+    if (!ffd->is_ready()) {
+        return;
+    }
+
     ffd->process_node();
     ffd->update_vertices(e->get_name() != "FFD_DRAG_EVENT");
 }
 
 /*
-* Simple recursive implementation for factorial.
+* Returns the actual index of the control point given i, j, k.
+*/
+int FreeFormDeform::get_point_index(int i, int j, int k) {
+    std::vector<int>& spans = _lattice->get_edge_spans();
+    return (i * (spans[1] + 1) + j) * (spans[2] + 1) + k;
+}
+
+
+/*
+* Resets all vertices of the given <binding> that are not influenced by any control point.
 */
-double FreeFormDeform::factorial(double n) {
-    if (n == 0) {
-        return 1;
+void FreeFormDeform::reset_vertices(Binding& binding) {
+    if (binding.non_influenced.empty()) {
+        return;
+    }
+
+    GeomVertexData* data = binding.data;
+    GeomVertexWriter rewriter(data, "vertex");
+    const DefaultVertices& default_vertices = binding.default_vertices;
+
+    // Iterate and set to the previous default space we got from calling process_node for the first time.
+    for (int point : binding.non_influenced) {
+        for (int r = binding.point_row_offsets[point]; r < binding.point_row_offsets[point + 1]; r++) {
+            rewriter.set_row(binding.point_rows[r]);
+            rewriter.set_data3f(default_vertices.x[point], default_vertices.y[point], default_vertices.z[point]);
+        }
+    }
+
+    if (!_deform_normals) {
+        return;
+    }
+
+    // Restore the rest frames as well:
+    const RestFrames& frames = binding.rest_frames;
+    const char* columns[3] = { "normal", "tangent", "binormal" };
+    const pvector<LVector3f>* rest[3] = { &frames.normal, &frames.tangent, &frames.binormal };
+
+    for (int c = 0; c < 3; c++) {
+        if (!data->has_column(columns[c])) {
+            continue;
+        }
+        GeomVertexWriter frame_writer(data, columns[c]);
+        for (int point : binding.non_influenced) {
+            for (int r = binding.point_row_offsets[point]; r < binding.point_row_offsets[point + 1]; r++) {
+                int row = binding.point_rows[r];
+                frame_writer.set_row(row);
+                frame_writer.set_data3f((*rest[c])[row]);
+            }
+        }
     }
-    return n * factorial(n - 1);
 }
 
 /*
-* Returns the actual index of the control point given i, j, k.
+* Deforms all points of <binding> that are influenced without regard for control point information.
 */
-int FreeFormDeform::get_point_index(int i, int j, int k) {
-    std::vector<int>& spans = _lattice->get_edge_spans();
-    return i * (spans[2] + 1) * (spans[2] + 1) + j * (spans[1] + 1) + k;
+void FreeFormDeform::transform_all_influenced(Binding& binding) {
+    queue_points(binding, binding.influence.get_all_vertices());
+}
+
+/*
+* Deforms all points that are being influenced by the given control points.
+*/
+void FreeFormDeform::transform_vertex(Binding& binding, std::vector<int>& control_points) {
+    // Points influenced by any of the control points, merged once per selection:
+    const pvector<int>& points = binding.influence.get_vertices(control_points);
+
+    if (!_incremental || _deform_normals) {
+        queue_points(binding, points);
+        return;
+    }
+
+    // Incremental: update_vertices already brought the deformed positions up to date.
+    GeomVertexWriter rewriter(binding.data, "vertex");
+    const pvector<LPoint3f>& positions = binding.deformed_positions;
+    for (int point : points) {
+        for (int r = binding.point_row_offsets[point]; r < binding.point_row_offsets[point + 1]; r++) {
+            rewriter.set_row(binding.point_rows[r]);
+            rewriter.set_data3f(positions[point]);
+        }
+    }
 }
 
+/*
+* Adds w(vertex, control point) * delta to the deformed positions for each control point in
+* <control_points>, delta being its movement since the previous update.
+*
+* Returns false (without modifying anything) if deltas are not enough: nothing
+* is anchored yet, the anchor interval elapsed, or a control point that isn't
+* selected moved as well.
+*/
+bool FreeFormDeform::apply_control_point_deltas(std::vector<int>& control_points) {
+    const pvector<LVecBase4f>& current = _lattice->get_control_point_buffer();
+    const pvector<LVecBase4f>& previous = _lattice->get_previous_control_point_buffer();
+
+    if (!_anchored || _updates_since_anchor >= _anchor_interval || previous.size() != current.size()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < current.size(); i++) {
+        if (current[i] != previous[i] &&
+            std::find(control_points.begin(), control_points.end(), (int)i) == control_points.end()) {
+            return false;
+        }
+    }
+
+    for (int control_point : control_points) {
+        LVecBase3f delta = (current[control_point] - previous[control_point]).get_xyz();
+        if (delta == LVecBase3f::zero()) {
+            continue;
+        }
+        for (Binding& binding : _bindings) {
+            binding.weights.add_column(control_point, delta, binding.deformed_positions.data());
+        }
+    }
+
+    _updates_since_anchor++;
+    return true;
+}
+
+/*
+* Fully evaluates the deformed positions for every point of every binding from the current
+* control point buffer. Points are split into chunks on the thread pool.
+*/
+void FreeFormDeform::anchor_deformed_positions() {
+    const LVecBase4f* control_point_buffer = _lattice->get_control_point_buffer().data();
+
+    // (binding, first point) for each chunk:
+    pvector<std::pair<size_t, size_t>> chunks;
+    for (size_t i = 0; i < _bindings.size(); i++) {
+        size_t num_rows = _bindings[i].weights.get_num_rows();
+        _bindings[i].deformed_positions.resize(num_rows);
+        for (size_t begin = 0; begin < num_rows; begin += _DEFORM_CHUNK_SIZE) {
+            chunks.push_back(std::make_pair(i, begin));
+        }
+    }
+
+    run_tasks(chunks.size(), [&](size_t chunk, int) {
+        const WeightMatrix& weights = _bindings[chunks[chunk].first].weights;
+        LPoint3f* positions = _bindings[chunks[chunk].first].deformed_positions.data();
+        size_t end = std::min(chunks[chunk].second + _DEFORM_CHUNK_SIZE, weights.get_num_rows());
+        for (size_t row = chunks[chunk].second; row < end; row++) {
+            positions[row] = weights.transform_row(row, control_point_buffer);
+        }
+    });
+
+    _anchored = true;
+    _updates_since_anchor = 0;
+}
 
 /*
-* Returns true/false if the given control point influences the given vertex (stu).
-* The berstein polynomial (for all ijk and spans and stu), will return 0 if there's no influence.
+* Queues the given points of <binding> to be deformed by run_jobs.
 */
-bool FreeFormDeform::is_influenced(int index, LVector3f stu) {
+void FreeFormDeform::queue_points(Binding& binding, const pvector<int>& points) {
+    if (points.empty()) {
+        return;
+    }
+
+    _jobs.push_back(DeformJob());
+    DeformJob& job = _jobs.back();
+    job.binding = &binding;
+    job.points = points;
+    job.positions.resize(job.points.size());
+
+    if (_deform_normals) {
+        job.jacobians.resize(3 * job.points.size());
+    }
+}
+
+/*
+* Deforms every queued job, then scatters the results to every row of each point.
+* Positions are only written once every chunk has joined, so the output matches the serial path.
+*/
+void FreeFormDeform::run_jobs() {
+    evaluate_jobs(_jobs);
+
+    for (DeformJob& job : _jobs) {
+        const Binding& binding = *job.binding;
+        GeomVertexWriter rewriter(binding.data, "vertex");
+        for (size_t i = 0; i < job.points.size(); i++) {
+            int point = job.points[i];
+            for (int r = binding.point_row_offsets[point]; r < binding.point_row_offsets[point + 1]; r++) {
+                rewriter.set_row(binding.point_rows[r]);
+                rewriter.set_data3f(job.positions[i]);
+            }
+        }
+
+        if (!job.jacobians.empty()) {
+            write_frames(job);
+        }
+    }
+    _jobs.clear();
+}
+
+/*
+* Transforms the rest frames of every row of the job's points by their point's Jacobian
+* and writes them. Normals are transformed by its inverse-transpose (its cofactor matrix,
+* as only the direction matters), tangents and binormals by the Jacobian itself.
+*/
+void FreeFormDeform::write_frames(const DeformJob& job) {
+    const Binding& binding = *job.binding;
+    GeomVertexData* data = binding.data;
+
+    const RestFrames& frames = binding.rest_frames;
+    const char* columns[3] = { "normal", "tangent", "binormal" };
+    const pvector<LVector3f>* rest[3] = { &frames.normal, &frames.tangent, &frames.binormal };
+
+    for (int c = 0; c < 3; c++) {
+        if (!data->has_column(columns[c])) {
+            continue;
+        }
+
+        GeomVertexWriter frame_writer(data, columns[c]);
+        for (size_t i = 0; i < job.points.size(); i++) {
+            const LVector3f* j_col = &job.jacobians[3 * i];
+            LVector3f cofactor[3] = {
+                j_col[1].cross(j_col[2]),
+                j_col[2].cross(j_col[0]),
+                j_col[0].cross(j_col[1]),
+            };
+
+            // A mirrored lattice flips the cofactor's orientation:
+            if (j_col[0].dot(cofactor[0]) < 0.0f) {
+                cofactor[0] = -cofactor[0];
+                cofactor[1] = -cofactor[1];
+                cofactor[2] = -cofactor[2];
+            }
+            const LVector3f* matrix = c == 0 ? cofactor : j_col;
+
+            int point = job.points[i];
+            for (int r = binding.point_row_offsets[point]; r < binding.point_row_offsets[point + 1]; r++) {
+                int row = binding.point_rows[r];
+                const LVector3f& v = (*rest[c])[row];
+                LVector3f frame = matrix[0] * v[0] + matrix[1] * v[1] + matrix[2] * v[2];
+                frame.normalize();
+
+                frame_writer.set_row(row);
+                frame_writer.set_data3f(frame);
+            }
+        }
+    }
+}
+
+/*
+* Evaluates <jobs> without writing them back. Jobs are split into chunks of
+* _DEFORM_CHUNK_SIZE points across all bindings and handed to the thread pool.
+*/
+void FreeFormDeform::evaluate_jobs(pvector<DeformJob>& jobs) {
+    // (job, first point) for each chunk:
+    pvector<std::pair<size_t, size_t>> chunks;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        for (size_t begin = 0; begin < jobs[i].points.size(); begin += _DEFORM_CHUNK_SIZE) {
+            chunks.push_back(std::make_pair(i, begin));
+        }
+    }
+
+    reserve_worker_scratch();
+    run_tasks(chunks.size(), [&](size_t chunk, int worker) {
+        DeformJob& job = jobs[chunks[chunk].first];
+        size_t begin = chunks[chunk].second;
+        size_t end = std::min(begin + _DEFORM_CHUNK_SIZE, job.points.size());
+        evaluate_points(job, begin, end, worker);
+    });
+}
+
+/*
+* Deforms points [begin, end) of <job> through the current DeformPath into job.positions.
+* Only reads shared state, so chunks of the same job may run on different workers.
+*/
+void FreeFormDeform::evaluate_points(DeformJob& job, size_t begin, size_t end, int worker) {
+    const LVecBase4f* control_point_buffer = _lattice->get_control_point_buffer().data();
+    const ParameterStreams& streams = job.binding->default_vertices.parameters;
+
+    if (!job.jacobians.empty()) {
+        evaluate_points_with_jacobians(job, begin, end);
+        return;
+    }
+
+    if (_deform_path == DP_grid) {
+        // Eight lookups per point, see update_grid.
+        for (size_t i = begin; i < end; i++) {
+            int point = job.points[i];
+            job.positions[i] = _grid.sample(streams.s[point], streams.t[point], streams.u[point]);
+        }
+        return;
+    }
+
+    // The batched kernels only know the Bernstein basis; B-spline rows are sparse anyway.
+    if (_deform_path == DP_weights || _lattice->get_basis_type() == Lattice::BT_bspline) {
+        // Each point is the dot product of its cached weights and the control points.
+        for (size_t i = begin; i < end; i++) {
+            job.positions[i] = job.binding->weights.transform_row(job.points[i], control_point_buffer);
+        }
+        return;
+    }
+
+    // Gather the (s,t,u) of the points into contiguous streams and evaluate them in bulk:
+    ParameterStreams& scratch = _worker_scratch[worker];
+    size_t count = end - begin;
+    scratch.s.resize(count);
+    scratch.t.resize(count);
+    scratch.u.resize(count);
+
+    for (size_t i = 0; i < count; i++) {
+        int point = job.points[begin + i];
+        scratch.s[i] = streams.s[point];
+        scratch.t[i] = streams.t[point];
+        scratch.u[i] = streams.u[point];
+    }
+
+    DEFORM_KERNEL::deform(_instruction_set, scratch.s.data(), scratch.t.data(), scratch.u.data(), count,
+        _lattice->get_edge_spans(), control_point_buffer, &job.positions[begin]);
+}
+
+/*
+* Fused exact pass: deforms points [begin, end) of <job> and, from the same basis rows,
+* the FFD Jacobian J = dX/d(s,t,u) * d(s,t,u)/d(vertex), stored as its three columns.
+* See write_frames.
+*/
+void FreeFormDeform::evaluate_points_with_jacobians(DeformJob& job, size_t begin, size_t end) {
     std::vector<int>& spans = _lattice->get_edge_spans();
-    std::vector<int> &ijk = _lattice->get_ijk(index);
-    return bernstein(ijk[0], 0, spans[0], stu[0]) * bernstein(ijk[1], 1, spans[1], stu[1]) * bernstein(ijk[2], 2, spans[2], stu[2]);
+    const LVecBase4f* control_points = _lattice->get_control_point_buffer().data();
+    const ParameterStreams& streams = job.binding->default_vertices.parameters;
+
+    pvector<double> rows[3], derivative_rows[3];
+
+    for (size_t i = begin; i < end; i++) {
+        int point = job.points[i];
+        LPoint3f stu(streams.s[point], streams.t[point], streams.u[point]);
+        basis_rows(stu, rows);
+        basis_derivative_rows(stu, derivative_rows);
+
+        // Position and its partials along s, t and u in one sweep over the control points:
+        LVector3f x(0), dx_ds(0), dx_dt(0), dx_du(0);
+        int p_index = 0;
+        for (int a = 0; a <= spans[0]; a++) {
+            for (int b = 0; b <= spans[1]; b++) {
+                for (int c = 0; c <= spans[2]; c++) {
+                    LVector3f control_point = control_points[p_index].get_xyz();
+                    x += (rows[0][a] * rows[1][b] * rows[2][c]) * control_point;
+                    dx_ds += (derivative_rows[0][a] * rows[1][b] * rows[2][c]) * control_point;
+                    dx_dt += (rows[0][a] * derivative_rows[1][b] * rows[2][c]) * control_point;
+                    dx_du += (rows[0][a] * rows[1][b] * derivative_rows[2][c]) * control_point;
+                    p_index++;
+                }
+            }
+        }
+        job.positions[i] = x;
+
+        // Columns of J:
+        for (int axis = 0; axis < 3; axis++) {
+            job.jacobians[3 * i + axis] = dx_ds * _parameter_mat(axis, 0) +
+                dx_dt * _parameter_mat(axis, 1) +
+                dx_du * _parameter_mat(axis, 2);
+        }
+    }
+}
+
+/*
+* Deforms <count> raw points through the lattice without touching the scene graph,
+* e.g. particles or point clouds. <in> and <out> are arrays of at least three floats
+* per point, <in_stride> and <out_stride> bytes apart; they may be the same buffer if
+* the strides match.
+*
+* Points are given in the space the lattice was fit to (like the "vertex" column of the
+* bound mesh) and come out in the space of the deformed vertices. Points outside the
+* lattice are copied unchanged. The control points of the last update_vertices are used,
+* so points stay in sync with the mesh; DP_grid samples the grid, every other
+* DeformPath deforms exactly. Chunks run on the thread pool.
+*/
+void FreeFormDeform::deform_points(const float* in, size_t in_stride, float* out, size_t out_stride, size_t count) {
+    if (_lattice->get_control_point_buffer().empty()) {
+        _lattice->update_control_point_buffer(_np);
+    }
+    if (_deform_path == DP_grid && _grid_dirty) {
+        update_grid();
+    }
+    if (!captured_default_vertices) {
+        capture_parameterization();
+    }
+
+    const unsigned char* in_bytes = (const unsigned char*)in;
+    unsigned char* out_bytes = (unsigned char*)out;
+
+    size_t num_chunks = (count + _DEFORM_CHUNK_SIZE - 1) / _DEFORM_CHUNK_SIZE;
+    reserve_worker_scratch();
+    run_tasks(num_chunks, [&](size_t chunk, int worker) {
+        size_t begin = chunk * _DEFORM_CHUNK_SIZE;
+        size_t size = std::min(_DEFORM_CHUNK_SIZE, count - begin);
+
+        // Parameterize the chunk, the same way as the bound mesh:
+        ParameterStreams& scratch = _worker_scratch[worker];
+        scratch.s.resize(size);
+        scratch.t.resize(size);
+        scratch.u.resize(size);
+        for (size_t i = 0; i < size; i++) {
+            const float* point = (const float*)(in_bytes + (begin + i) * in_stride);
+            LPoint3f stu = get_parameters(LPoint3f(point[0], point[1], point[2]));
+            scratch.s[i] = stu[0];
+            scratch.t[i] = stu[1];
+            scratch.u[i] = stu[2];
+        }
+
+        pvector<LPoint3f>& points = _worker_points[worker];
+        points.resize(size);
+        if (_deform_path == DP_grid) {
+            for (size_t i = 0; i < size; i++) {
+                points[i] = _grid.sample(scratch.s[i], scratch.t[i], scratch.u[i]);
+            }
+        }
+        else {
+            evaluate_exact(scratch.s.data(), scratch.t.data(), scratch.u.data(), size,
+                _lattice->get_control_point_buffer().data(), points.data(), worker);
+        }
+
+        for (size_t i = 0; i < size; i++) {
+            bool in_range = scratch.s[i] >= 0.0f && scratch.s[i] <= 1.0f &&
+                scratch.t[i] >= 0.0f && scratch.t[i] <= 1.0f &&
+                scratch.u[i] >= 0.0f && scratch.u[i] <= 1.0f;
+
+            const float* point = (const float*)(in_bytes + (begin + i) * in_stride);
+            float* result = (float*)(out_bytes + (begin + i) * out_stride);
+            if (in_range) {
+                result[0] = points[i][0];
+                result[1] = points[i][1];
+                result[2] = points[i][2];
+            }
+            else if (result != point) {
+                result[0] = point[0];
+                result[1] = point[1];
+                result[2] = point[2];
+            }
+        }
+    });
+}
+
+/*
+* Sizes the per-worker scratch to the thread pool.
+*/
+void FreeFormDeform::reserve_worker_scratch() {
+    size_t num_threads = _thread_pool->get_num_threads();
+    _worker_scratch.resize(std::max(_worker_scratch.size(), num_threads));
+    _worker_points.resize(std::max(_worker_points.size(), num_threads));
+    _worker_basis.resize(std::max(_worker_basis.size(), num_threads));
 }
 
 /*
-* Resets all vertices of the given <data> that are not influenced by any control point.
+* Exactly deforms <count> points given by s, t, u streams into <out> with the given
+* control points, regardless of the DeformPath. <worker> selects the scratch rows;
+* see reserve_worker_scratch.
+*
+* Bernstein lattices go through the batched DEFORM_KERNEL. B-spline rows are sparse,
+* so each point only visits the control points of its cell neighbourhood (see
+* basis_support), reusing the worker's rows instead of allocating per point.
 */
-void FreeFormDeform::reset_vertices(GeomVertexData* data, GeomNode* geom_node, std::vector<int>& indices) {
-    if (_non_influenced_vertex.find(geom_node) == _non_influenced_vertex.end()) {
+void FreeFormDeform::evaluate_exact(const float* s, const float* t, const float* u, size_t count,
+    const LVecBase4f* control_points, LPoint3f* out, int worker) {
+    if (_lattice->get_basis_type() == Lattice::BT_bernstein) {
+        DEFORM_KERNEL::deform(_instruction_set, s, t, u, count,
+            _lattice->get_edge_spans(), control_points, out);
         return;
     }
 
-    GeomVertexWriter rewriter(data, "vertex");
-    LPoint3f default_vertex_pos;
-    
-    // Now, we want to iterate through vertices that are NOT affected at all.
-    int vertex_count = 0;
+    pvector<double>* rows = _worker_basis[worker].rows;
+    for (size_t v = 0; v < count; v++) {
+        LPoint3f stu(s[v], t[v], u[v]);
+        basis_rows(stu, rows);
 
-    // Iterate and set to the previous default space we got from calling process_node for the first time.
-    for (size_t i = 0; i < _non_influenced_vertex[geom_node].size(); i++) {
-        int t = _non_influenced_vertex[geom_node][i];
-        rewriter.set_row(t);
-        default_vertex_pos = _default_vertex_ws_os[geom_node][t][0];
-        rewriter.set_data3f(default_vertex_pos);
+        int begin[3], end[3];
+        for (int axis = 0; axis < 3; axis++) {
+            basis_support(axis, stu[axis], begin[axis], end[axis]);
+        }
+
+        LVector3f point(0);
+        for (int i = begin[0]; i <= end[0]; i++) {
+            for (int j = begin[1]; j <= end[1]; j++) {
+                double weight_ij = rows[0][i] * rows[1][j];
+                int ctrl_i = get_point_index(i, j, begin[2]);
+                for (int k = begin[2]; k <= end[2]; k++, ctrl_i++) {
+                    point += (float)(weight_ij * rows[2][k]) * control_points[ctrl_i].get_xyz();
+                }
+            }
+        }
+        out[v] = point;
     }
 }
 
 /*
-* Deforms all vertices within <data> that are influenced without regard for control point information.
+* Re-evaluates every sample of the DeformationGrid from the current control point buffer,
+* in chunks on the thread pool.
 */
-void FreeFormDeform::transform_all_influenced(GeomVertexData* data, GeomNode* geom_node) {
-    GeomVertexWriter rewriter(data, "vertex");
-    LPoint3f default_vertex, default_object_space; // (stu)
-    LVector3f x_ffd;
+void FreeFormDeform::update_grid() {
+    const LVecBase4f* control_points = _lattice->get_control_point_buffer().data();
+    LPoint3f* samples = _grid.modify_samples().data();
+    size_t num_samples = _grid.get_num_samples();
+
+    reserve_worker_scratch();
+    size_t num_chunks = (num_samples + _DEFORM_CHUNK_SIZE - 1) / _DEFORM_CHUNK_SIZE;
+    run_tasks(num_chunks, [&](size_t chunk, int worker) {
+        size_t begin = chunk * _DEFORM_CHUNK_SIZE;
+        size_t size = std::min(_DEFORM_CHUNK_SIZE, num_samples - begin);
+        evaluate_exact(&_grid_parameters.s[begin], &_grid_parameters.t[begin], &_grid_parameters.u[begin], size,
+            control_points, samples + begin, worker);
+    });
+    _grid_dirty = false;
+}
 
-    pmap<int, pvector<int>> influence_map = _influenced_vertices[geom_node]; // key is ctrl point.
-    pvector<int> vertices;
-    pvector<LPoint3f> default_vertex_pos;
+/*
+* Estimates the error of DP_grid against the exact map for the current control points.
+* Trilinear interpolation is worst away from the samples, so this compares both at
+* every cell center and returns the largest distance, in units of the deformation space.
+*
+* Works on a snapshot of the control points and a copy of the grid, so the control
+* point history update_vertices compares against (and the grid itself) is untouched.
+*/
+double FreeFormDeform::estimate_grid_error() {
+    pvector<LVecBase4f> control_points;
+    _lattice->resolve_control_points(_np, control_points);
 
-    std::unordered_set<int> _vertices2;
+    DeformationGrid grid = _grid;
+    reserve_worker_scratch();
+    evaluate_exact(_grid_parameters.s.data(), _grid_parameters.t.data(), _grid_parameters.u.data(),
+        grid.get_num_samples(), control_points.data(), grid.modify_samples().data());
 
-    // Our vertex can be controlled by multiple points.
-    // For this reason, we need to remove any duplicates
-    // so we're not doing unnecessary processing.
-    int vertex = 0;
-    for (int i = 0; i < influence_map.size(); i++) {
-        vertices = influence_map[i];
-        for (int j = 0; j < vertices.size(); j++) {
-            vertex = vertices[j];
-            _vertices2.insert(vertex);
+    int cells = _grid.get_resolution() - 1;
+    ParameterStreams centers;
+    for (int i = 0; i < cells; i++) {
+        for (int j = 0; j < cells; j++) {
+            for (int k = 0; k < cells; k++) {
+                centers.s.push_back((i + 0.5f) / cells);
+                centers.t.push_back((j + 0.5f) / cells);
+                centers.u.push_back((k + 0.5f) / cells);
+            }
         }
     }
 
-    // Iterate through duplicates and deform.
-    for (const int& vertex : _vertices2) {
-        rewriter.set_row(vertex);
-        default_vertex_pos = _default_vertex_ws_os[geom_node][vertex];
-        default_vertex = default_vertex_pos[0];
-        double s = default_vertex_pos[1][0];
-        double t = default_vertex_pos[1][1];
-        double u = default_vertex_pos[1][2];
+    pvector<LPoint3f> exact(centers.s.size());
+    evaluate_exact(centers.s.data(), centers.t.data(), centers.u.data(), exact.size(),
+        control_points.data(), exact.data());
 
-        x_ffd = deform_vertex(s, t, u);
-        rewriter.set_data3f(x_ffd);
+    double error = 0.0;
+    for (size_t i = 0; i < exact.size(); i++) {
+        LVector3f delta = exact[i] - grid.sample(centers.s[i], centers.t[i], centers.u[i]);
+        error = std::max(error, (double)delta.length());
     }
+    return error;
 }
 
 /*
-* Deforms all vertices that are being influenced by the given control points.
+* Microbenchmarks every deformation back-end on the bound mesh and lattice, then
+* switches to the fastest one whose error stays within get_tune_max_error.
+*
+* Back-ends are every DeformPath, every instruction set the CPU supports for
+* DP_vectorized, each single-threaded and on every hardware thread. Up to
+* _TUNE_SAMPLE_ROWS points, spread evenly over every geom, are deformed with the
+* control points jittered by a fraction of a cell (so the approximate paths are
+* measured against a non-trivial deformation) and compared with the exact map.
+* DP_grid is timed including its grid update. The control points are left untouched.
+*
+* If no back-end is accurate enough, the most accurate one is picked.
+* The measurements are kept, see get_tune_results and get_tune_choice.
 */
-void FreeFormDeform::transform_vertex(GeomVertexData* data, GeomNode* geom_node, std::vector<int>& control_points) {
-    GeomVertexWriter rewriter(data, "vertex");
+void FreeFormDeform::tune() {
+    _tune_results.clear();
+    _tune_choice = -1;
 
-    LPoint3f default_vertex, default_object_space; // (stu)
-    LVector3f x_ffd;
+    size_t total_points = 0;
+    for (const Binding& binding : _bindings) {
+        total_points += binding.default_vertices.x.size();
+    }
+    if (total_points == 0) {
+        return;
+    }
 
-    // Check who is being influenced by control points.
-    std::unordered_set<int> vertices;
-    for (size_t i = 0; i < control_points.size(); i++) {
-        pvector<int>& influenced_arrays = _influenced_vertices[geom_node][i];
-        for (int v : influenced_arrays) {
-            vertices.insert(v);
+    // Sample evenly strided points of every binding, and their exact deformation:
+    size_t stride = (total_points + _TUNE_SAMPLE_ROWS - 1) / _TUNE_SAMPLE_ROWS;
+    size_t sampled_points = 0;
+    pvector<DeformJob> jobs;
+    for (const Binding& binding : _bindings) {
+        DeformJob job;
+        job.binding = &binding;
+        for (size_t point = 0; point < binding.default_vertices.x.size(); point += stride) {
+            job.points.push_back((int)point);
         }
+        job.positions.resize(job.points.size());
+        sampled_points += job.points.size();
+        jobs.push_back(job);
     }
-    pvector<LPoint3f> default_vertex_pos;
 
-    for (const int& vertex : vertices) {
-        default_vertex_pos = _default_vertex_ws_os[geom_node][vertex];
+    // Jitter the control points, deterministically so results are reproducible:
+    _lattice->update_control_point_buffer(_np);
+    pvector<LVecBase4f> rest_buffer = _lattice->get_control_point_buffer();
+    pvector<LVecBase4f>& buffer = _lattice->modify_control_point_buffer();
+    pvector<LVector3f> lattice_vec = _lattice->get_lattice_vecs();
+    std::vector<int>& spans = _lattice->get_edge_spans();
 
-        rewriter.set_row(vertex);
+    // Along S, T and U (in the model's space, like the buffer), a fraction of a cell each:
+    LMatrix4f to_model = _top_node.get_mat(_np);
+    LVector3f cell_vec[3];
+    for (int axis = 0; axis < 3; axis++) {
+        cell_vec[axis] = to_model.xform_vec(lattice_vec[axis]) * (_TUNE_JITTER / std::max(1, spans[axis]));
+    }
 
-        default_vertex = default_vertex_pos[0];
-        double s = default_vertex_pos[1][0];
-        double t = default_vertex_pos[1][1];
-        double u = default_vertex_pos[1][2];
+    unsigned int seed = 1;
+    for (LVecBase4f& point : buffer) {
+        for (int axis = 0; axis < 3; axis++) {
+            seed = seed * 1103515245u + 12345u;
+            float random = ((seed >> 16) & 0x7fff) / 16383.5f - 1.0f;
+            point += LVecBase4f(cell_vec[axis] * random, 0.0f);
+        }
+    }
 
-        x_ffd = deform_vertex(s, t, u);
-        rewriter.set_data3f(x_ffd);
+    pvector<pvector<LPoint3f>> reference(jobs.size());
+    reserve_worker_scratch();
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const ParameterStreams& streams = jobs[i].binding->default_vertices.parameters;
+        ParameterStreams sample;
+        for (int point : jobs[i].points) {
+            sample.s.push_back(streams.s[point]);
+            sample.t.push_back(streams.t[point]);
+            sample.u.push_back(streams.u[point]);
+        }
+        reference[i].resize(jobs[i].points.size());
+        evaluate_exact(sample.s.data(), sample.t.data(), sample.u.data(), sample.s.size(),
+            buffer.data(), reference[i].data());
     }
+
+    // Candidates at one thread and at the whole (shared) pool; only this instance's
+    // cap changes, the pool itself is never resized:
+    int thread_counts[2] = { 1, _thread_pool->get_num_threads() };
+    for (int n = 0; n < (thread_counts[1] > 1 ? 2 : 1); n++) {
+        _tune_results.push_back({ DP_weights, _instruction_set, thread_counts[n], 0.0, 0.0 });
+        if (_lattice->get_basis_type() == Lattice::BT_bernstein) {
+            for (int is = DEFORM_KERNEL::IS_scalar; is <= DEFORM_KERNEL::get_best_instruction_set(); is++) {
+                _tune_results.push_back({ DP_vectorized, (DEFORM_KERNEL::InstructionSet)is, thread_counts[n], 0.0, 0.0 });
+            }
+        }
+        _tune_results.push_back({ DP_grid, _instruction_set, thread_counts[n], 0.0, 0.0 });
+    }
+
+    // The frames only ride along the position pass; tune that alone.
+    bool deform_normals = _deform_normals;
+    _deform_normals = false;
+
+    double scale = (double)total_points / sampled_points;
+    for (TuneResult& result : _tune_results) {
+        _deform_path = result.path;
+        _instruction_set = result.instruction_set;
+        _num_threads = result.num_threads;
+
+        // Best of a few runs; the grid update doesn't grow with the vertex count.
+        result.seconds = std::numeric_limits<double>::infinity();
+        for (int r = 0; r < _TUNE_REPETITIONS; r++) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            if (result.path == DP_grid) {
+                update_grid();
+            }
+            std::chrono::steady_clock::time_point grid_end = std::chrono::steady_clock::now();
+            evaluate_jobs(jobs);
+            std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+            double seconds = std::chrono::duration<double>(grid_end - start).count() +
+                std::chrono::duration<double>(end - grid_end).count() * scale;
+            result.seconds = std::min(result.seconds, seconds);
+        }
+
+        result.error = 0.0;
+        for (size_t i = 0; i < jobs.size(); i++) {
+            for (size_t j = 0; j < jobs[i].points.size(); j++) {
+                result.error = std::max(result.error, (double)(jobs[i].positions[j] - reference[i][j]).length());
+            }
+        }
+    }
+
+    // Fastest accurate enough back-end, otherwise the most accurate one:
+    for (size_t i = 0; i < _tune_results.size(); i++) {
+        const TuneResult& result = _tune_results[i];
+        if (result.error > _tune_max_error) {
+            continue;
+        }
+        if (_tune_choice < 0 || result.seconds < _tune_results[_tune_choice].seconds) {
+            _tune_choice = (int)i;
+        }
+    }
+    if (_tune_choice < 0) {
+        _tune_choice = 0;
+        for (size_t i = 1; i < _tune_results.size(); i++) {
+            if (_tune_results[i].error < _tune_results[_tune_choice].error) {
+                _tune_choice = (int)i;
+            }
+        }
+    }
+
+    const TuneResult& choice = _tune_results[_tune_choice];
+    _deform_path = choice.path;
+    _instruction_set = choice.instruction_set;
+    _num_threads = choice.num_threads;
+
+    // Restore the real control points; the grid and incremental cache saw the jittered ones.
+    _deform_normals = deform_normals;
+    buffer = rest_buffer;
+    _grid_dirty = true;
+    _anchored = false;
 }
 
 /*
-* Primary deformation function. Parameters s, t, u are the
+* Reference deformation function. Parameters s, t, u are the
 * default vertex position previously calculated in process_node.
+* The update path uses the cached weights (see build_weights) instead.
 */
 LVector3f FreeFormDeform::deform_vertex(double s, double t, double u) {
     std::vector<int>& spans = _lattice->get_edge_spans();
+    const pvector<LVecBase4f>& control_points = _lattice->get_control_point_buffer();
+
+    pvector<double> rows[3];
+    basis_rows(LPoint3f(s, t, u), rows);
 
-    double bernstein_coeff;
     int p_index = 0;
 
     // For nesting together all i, j, k between and including their respective spans (l, m, n)
-    // Will call the berstein polynomial on the lowest and begin performing an
+    // Will take the berstein polynomial of the lowest and begin performing an
     // scaled multiply operation backwards.
 
     LVector3f vec_i = LVector3f(0);
@@ -196,17 +1153,12 @@ LVector3f FreeFormDeform::deform_vertex(double s, double t, double u) {
         for (int j = 0; j <= spans[1]; j++) {
             LVector3f vec_k = LVector3f(0);
             for (int k = 0; k <= spans[2]; k++) {
-                bernstein_coeff = bernstein(k, 2, spans[2], u);
-
-                vec_k += bernstein_coeff * _lattice->get_control_point_pos(p_index, _top_node);
-
+                vec_k += rows[2][k] * control_points[p_index].get_xyz();
                 p_index++;
             }
-            bernstein_coeff = bernstein(j, 1, spans[1], t);
-            vec_j += bernstein_coeff * vec_k;
+            vec_j += rows[1][j] * vec_k;
         }
-        bernstein_coeff = bernstein(i, 0, spans[0], s);
-        vec_i += bernstein_coeff * vec_j;
+        vec_i += rows[0][i] * vec_j;
     }
 
     return vec_i;
@@ -214,7 +1166,8 @@ LVector3f FreeFormDeform::deform_vertex(double s, double t, double u) {
 
 /*
 * Internally calls transform_all_influenced or transform_vertex.
-* Will always call reset_vertices afterwards.
+* Will always call reset_vertices afterwards. The queued deformation
+* is then run on the thread pool (see run_jobs).
 * 
 * <force> argument is for when we are selecting the actual NodePath and not
 * any control points. In this case, it will transform all influenced vertices
@@ -225,26 +1178,64 @@ LVector3f FreeFormDeform::deform_vertex(double s, double t, double u) {
 void FreeFormDeform::update_vertices(bool force) {
     std::vector<int> &control_point_indices = _lattice->get_selected_control_points();
 
-    PT(GeomVertexData) vertex_data;
-    PT(Geom) geom;
+    // Resolve the control points into the deformation space (the model's) once for this update:
+    _lattice->update_control_point_buffer(_np);
 
-    // Iterate through geom_nodes and their child geoms:
-    for (GeomNode* geom_node : _geom_nodes) {
-        for (size_t i = 0; i < geom_node->get_num_geoms(); i++) {
-            geom = geom_node->modify_geom(i);
-            vertex_data = geom->modify_vertex_data();
+    // A relative move is waiting to settle; until then the mesh keeps its last shape
+    // and simply moves with the model (see settle_task).
+    if (_reparameterize_pending) {
+        return;
+    }
 
-            // We may be reset then come back into scope of the lattice.
-            // At this point, we deform all vertices within the lattice.
-            if (control_point_indices.size() == 0 && force) {
-                transform_all_influenced(vertex_data, geom_node);
-            }
-            else {
-                // Otherwise, deform only what is influenced by the selected control points.
-                transform_vertex(vertex_data, geom_node, control_point_indices);
-            }
-            // We're going to reset the vertices that are no longer apart of the lattice.
-            reset_vertices(vertex_data, geom_node, control_point_indices);
+    // The model and lattice moved together rigidly (or not at all), and the binding is
+    // unchanged: every deformed vertex, being model-relative, is still correct. Moves
+    // are measured from the last buffer that counted, so slow drifts still add up.
+    const pvector<LVecBase4f>& control_points = _lattice->get_control_point_buffer();
+    bool moved = !almost_same_points(control_points, _deformed_control_points,
+        get_lattice_extent() * _BIND_TOLERANCE);
+    if (force && !_deformation_stale && !moved) {
+        return;
+    }
+
+    // A new binding changed every point's weights, not just the selection's.
+    bool rebound = _deformation_stale;
+    _deformation_stale = false;
+    if (moved) {
+        _deformed_control_points = control_points;
+    }
+
+    // The grid only has to follow the control points when they actually moved:
+    if (_deform_path == DP_grid && (_grid_dirty || moved)) {
+        update_grid();
+    }
+
+    // Incremental updates only need the deltas of the selected control points:
+    if (_incremental && !apply_control_point_deltas(control_point_indices)) {
+        anchor_deformed_positions();
+    }
+
+    // Each unique vertex data once, however many geoms draw it:
+    for (Binding& binding : _bindings) {
+        // We may be reset then come back into scope of the lattice.
+        // At this point, we deform all vertices within the lattice.
+        if ((control_point_indices.size() == 0 && force) || rebound) {
+            transform_all_influenced(binding);
+        }
+        else {
+            // Otherwise, deform only what is influenced by the selected control points.
+            transform_vertex(binding, control_point_indices);
+        }
+        // We're going to reset the vertices that are no longer apart of the lattice.
+        reset_vertices(binding);
+    }
+
+    // Deform everything queued above, possibly across threads:
+    run_jobs();
+
+    // The vertex data was written in place; let every geom drawing it recompute its bounds.
+    for (Binding& binding : _bindings) {
+        for (std::pair<PT(GeomNode), int>& geom : binding.geoms) {
+            geom.first->modify_geom(geom.second)->mark_bounds_stale();
         }
     }
 
@@ -261,9 +1252,16 @@ void FreeFormDeform::update_vertices(bool force) {
 * This vertex position is relative to itself, so the NodePath can always be manipulated
 * before and after.
 *
-* - Determines if a vertex is within the bounds of the Lattice or not.
+* - Determines if a vertex is within the bounds of the Lattice or not, in parallel
+*   over ranges of points.
 * - Converts all vertices to s,t,u space. 
 * - Creates influence relationship between vertex and control point.
+*
+* Does nothing unless the lattice frame relative to the model or the cached weights
+* changed since the last call; moving control points, or the model and lattice
+* together, never rebinds. Moving one relative to the other re-parameterizes the
+* rest vertices once the move settles (see settle_task), so they stay consistent
+* with the model-space control point buffer.
 */
 void FreeFormDeform::process_node() {
     // Ignore if there's nothing.
@@ -271,83 +1269,528 @@ void FreeFormDeform::process_node() {
         return;
     }
 
-    // Reset vectors/maps:
-    _influenced_vertices.clear();
-    _non_influenced_vertex.clear();
-    _geom_nodes.clear();
+    // Float noise from composing transforms is not a change, see _BIND_TOLERANCE.
+    LMatrix4f lattice_mat = _lattice->get_mat(_np);
+    bool moved = false;
+    if (captured_default_vertices) {
+        float extent = get_lattice_extent();
+        moved = !almost_same_transform(lattice_mat, _bound_lattice_mat, extent, extent * _BIND_TOLERANCE);
+    }
+    if (captured_default_vertices && !_binding_dirty && !moved) {
+        return;
+    }
+    _deformation_stale = true;
 
     // Begin by caculating stu based on our bounding box.
     _lattice->calculate_lattice_vec();
 
+    // First pass: capture the rest vertices and cache their weights.
+    if (!captured_default_vertices) {
+        _bound_lattice_mat = lattice_mat;
+        capture_default_vertices();
+        bind_vertices();
+        return;
+    }
+
+    // The lattice moved relative to the model: the vertices now sit elsewhere in it.
+    // Rebinding is far too heavy for every drag event, so it waits for the move to settle.
+    if (moved) {
+        _bound_lattice_mat = lattice_mat;
+        _reparameterize_pending = true;
+        schedule_settle();
+        if (!_binding_dirty) {
+            return;
+        }
+    }
+    classify_points();
+}
+
+/*
+* Second half of the first process_node, after capture_default_vertices: captures
+* the rest vertices and their weights and classifies them. Only reads and writes
+* vertex data, so the asynchronous bind runs it off the App thread.
+*/
+void FreeFormDeform::bind_vertices() {
+    capture_rest_vertices();
+    captured_default_vertices = true;
+    build_weights();
+    _anchored = false;
+    classify_points();
+}
+
+/*
+* Sorts every bound point into the influenced points of its binding, indexed by the
+* control points moving it, and the points outside of the lattice.
+*
+* A point is inside when its rest s,t,u are within [0, 1]: the test happens in the
+* model's space, against the lattice it was parameterized by, so neither the scene
+* graph nor the (possibly deformed) vertex data is read.
+*/
+void FreeFormDeform::classify_points() {
+    // First, classify every point in parallel, in chunks of (binding, first point):
+    pvector<pvector<unsigned char>> in_range(_bindings.size());
+    pvector<std::pair<size_t, size_t>> chunks;
+    for (size_t i = 0; i < _bindings.size(); i++) {
+        size_t num_points = _bindings[i].point_row_offsets.size() - 1;
+        in_range[i].resize(num_points);
+        for (size_t begin = 0; begin < num_points; begin += _DEFORM_CHUNK_SIZE) {
+            chunks.push_back(std::make_pair(i, begin));
+        }
+    }
+
+    run_tasks(chunks.size(), [&](size_t chunk, int) {
+        const Binding& binding = _bindings[chunks[chunk].first];
+        unsigned char* flags = in_range[chunks[chunk].first].data();
+        size_t end = std::min(chunks[chunk].second + _DEFORM_CHUNK_SIZE, binding.point_row_offsets.size() - 1);
+
+        const ParameterStreams& parameters = binding.default_vertices.parameters;
+        const float low = -_BIND_TOLERANCE, high = 1.0f + _BIND_TOLERANCE;
+        for (size_t point = chunks[chunk].second; point < end; point++) {
+            // We do not care about vertices that aren't within our lattice.
+            flags[point] = parameters.s[point] >= low && parameters.s[point] <= high &&
+                parameters.t[point] >= low && parameters.t[point] <= high &&
+                parameters.u[point] >= low && parameters.u[point] <= high;
+        }
+    });
+
+    // Then gather them in point order, so the result doesn't depend on the scheduling,
+    // and index each binding's influence on its own worker:
+    int num_control_points = _lattice->get_num_control_points();
+    run_tasks(_bindings.size(), [&](size_t b, int) {
+        Binding& binding = _bindings[b];
+        binding.non_influenced.clear();
+
+        pvector<int> influenced_points;
+        for (size_t point = 0; point < in_range[b].size(); point++) {
+            if (in_range[b][point]) {
+                // The control points modifying this point are exactly the (unpruned) weights of its row.
+                influenced_points.push_back((int)point);
+            }
+            else {
+                binding.non_influenced.push_back((int)point);
+            }
+        }
+        binding.influence.build(binding.weights, influenced_points, num_control_points);
+    });
+    _binding_dirty = false;
+}
+
+/*
+* Captures the mapping from a point to its s,t,u for the current lattice vectors.
+* A point is x0 + sS + tT + uU, so s,t,u are the point through the inverse of that
+* frame; inverted once here rather than solved per vertex. S, T and U may be oriented.
+*
+* The lattice vectors follow the edges, which follow the control points, so this is
+* only called while the lattice is at rest (bind time, or right after a rebuild). The
+* frame is kept in the lattice's own space; see compose_parameterization.
+* Axes without extent get a unit length from the lattice, so the frame is only
+* singular if the lattice itself collapsed.
+*/
+void FreeFormDeform::capture_parameterization() {
     pvector<LVector3f> lattice_vec = _lattice->get_lattice_vecs();
-    LVector3f S = lattice_vec[0];
-    LVector3f T = lattice_vec[1];
-    LVector3f U = lattice_vec[2];
 
-    GeomVertexReader v_reader;
-    LPoint3f vertex, vertex_minus_min;
+    LMatrix4f frame = LMatrix4f::ident_mat();
+    frame.set_row(0, lattice_vec[0]);
+    frame.set_row(1, lattice_vec[1]);
+    frame.set_row(2, lattice_vec[2]);
+    frame.set_row(3, _lattice->get_x0());
+    _rest_frame = frame * _top_node.get_mat(*_lattice);
 
-    pvector<LPoint3f> vertex_object_space;
+    compose_parameterization();
+}
 
-    CPT(GeomVertexData) vertex_data;
-    PT(GeomNode) geom_node;
-    CPT(Geom) geom;
+/*
+* Expresses the rest frame relative to the model, like the vertices and control points,
+* so the binding doesn't depend on where the model and lattice are in the scene, and
+* inverts it into _parameter_mat. After the model moved relative to the lattice this
+* gives the parameterization of the rest lattice at its new place, however the
+* control points were dragged since.
+*/
+void FreeFormDeform::compose_parameterization() {
+    LMatrix4f frame = _rest_frame * _lattice->get_mat(_np);
+
+    // A degenerate frame has no inverse; keep the last parameterization rather
+    // than binding every point to garbage.
+    LMatrix4f parameter_mat;
+    if (parameter_mat.invert_from(frame)) {
+        _parameter_mat = parameter_mat;
+    }
+}
+
+/*
+* Recomputes the s,t,u of every bound point after the lattice frame or spans changed,
+* then rebuilds everything derived from them.
+*/
+void FreeFormDeform::rebind_parameters() {
+    populate_lookup_table();
+    capture_parameterization();
+    reparameterize();
+    process_node();
+}
 
-    bool influenced = false;
+/*
+* Recomputes the s,t,u of every bound point through _parameter_mat, renumbers the
+* points in their new Morton order and rebuilds the weights. The influence index is
+* rebuilt by the next classify_points.
+*/
+void FreeFormDeform::reparameterize() {
+    for (Binding& binding : _bindings) {
+        capture_parameters(binding);
 
-    int row = 0;
+        // The Morton order follows s,t,u; rows keep their rest frames, only the
+        // points they map to are renumbered.
+        pvector<int> row_points(binding.point_rows.size());
+        size_t num_points = binding.point_row_offsets.size() - 1;
+        for (size_t point = 0; point < num_points; point++) {
+            for (int r = binding.point_row_offsets[point]; r < binding.point_row_offsets[point + 1]; r++) {
+                row_points[binding.point_rows[r]] = (int)point;
+            }
+        }
+        sort_points(binding, row_points);
+        build_point_rows(binding, row_points);
+    }
+    build_weights(false);
+    _bound_lattice_mat = _lattice->get_mat(_np);
+    _reparameterize_pending = false;
+    _anchored = false;
+    _grid_dirty = true;
+}
 
-    LVector3f x0 = _lattice->get_x0();
-    LVector3f x1 = _lattice->get_x1();
+/*
+* Orients the lattice to the principal axes of the bound rest points, so it hugs
+* rotated or diagonal assets instead of their axis-aligned bounds. The largest
+* spread goes along s, then u, then t. See set_lattice_frame.
+*/
+void FreeFormDeform::fit_lattice_frame() {
+    // Mean and covariance of every point:
+    double count = 0.0;
+    double mean[3] = {};
+    for (const Binding& binding : _bindings) {
+        const DefaultVertices& default_vertices = binding.default_vertices;
+        for (size_t point = 0; point < default_vertices.x.size(); point++) {
+            mean[0] += default_vertices.x[point];
+            mean[1] += default_vertices.y[point];
+            mean[2] += default_vertices.z[point];
+            count++;
+        }
+    }
+    if (count == 0.0) {
+        return;
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        mean[axis] /= count;
+    }
+
+    double covariance[3][3] = {};
+    for (const Binding& binding : _bindings) {
+        const DefaultVertices& default_vertices = binding.default_vertices;
+        for (size_t point = 0; point < default_vertices.x.size(); point++) {
+            double d[3] = {
+                default_vertices.x[point] - mean[0],
+                default_vertices.y[point] - mean[1],
+                default_vertices.z[point] - mean[2],
+            };
+            for (int r = 0; r < 3; r++) {
+                for (int c = 0; c < 3; c++) {
+                    covariance[r][c] += d[r] * d[c];
+                }
+            }
+        }
+    }
+
+    double axes[3][3];
+    principal_axes(covariance, axes);
+
+    // Into the lattice's (top node) space, right-handed so the frame is a pure rotation:
+    LMatrix4f to_top = _np.get_mat(_top_node);
+    LVector3f x = to_top.xform_vec(LVector3f(axes[0][0], axes[0][1], axes[0][2]));
+    LVector3f y = to_top.xform_vec(LVector3f(axes[1][0], axes[1][1], axes[1][2]));
+    x.normalize();
+    y = y - x * x.dot(y);
+    y.normalize();
+    LMatrix4f frame = LMatrix4f::ident_mat();
+    frame.set_row(0, x);
+    frame.set_row(1, y);
+    frame.set_row(2, x.cross(y));
+    set_lattice_frame(frame);
+}
+
+/*
+* Binds every unique GeomVertexData under the NodePath and captures the lattice frame
+* relative to the model. The scene graph side of the first bind; the lattice vectors
+* must be calculated. bind_vertices captures the vertices themselves.
+*
+* Geoms sharing vertex data share one binding. The data is made unique to this
+* NodePath once (copy-on-write, e.g. away from the model pool) and every geom that
+* drew it is pointed at that copy, so updates write it in place exactly once.
+*/
+void FreeFormDeform::capture_default_vertices() {
+    capture_parameterization();
+    _bindings.clear();
+
+    // Vertex data (as originally referenced, and our unique copy) -> binding:
+    pmap<const GeomVertexData*, size_t> binding_index;
+    pvector<CPT(GeomVertexData)> originals;
+
+    PT(GeomNode) geom_node;
+    PT(Geom) geom;
 
     for (size_t i = 0; i < _geom_node_collection.get_num_paths(); i++) {
         geom_node = DCAST(GeomNode, _geom_node_collection.get_path(i).node());
         for (size_t j = 0; j < geom_node->get_num_geoms(); j++) {
-            geom = geom_node->get_geom(j);
-            vertex_data = geom->get_vertex_data();
+            CPT(GeomVertexData) original = geom_node->get_geom(j)->get_vertex_data();
+            originals.push_back(original);
 
-            // Store our unmodified points:
-            v_reader = GeomVertexReader(vertex_data, "vertex");
-            row = 0;
-            while (!v_reader.is_at_end()) {
-                vertex = v_reader.get_data3f();
+            geom = geom_node->modify_geom(j);
+            pmap<const GeomVertexData*, size_t>::iterator it = binding_index.find(original);
+            if (it == binding_index.end()) {
+                _bindings.push_back(Binding());
+                Binding& binding = _bindings.back();
+                binding.data = geom->modify_vertex_data();
+                binding_index[original] = _bindings.size() - 1;
+                binding_index[binding.data] = _bindings.size() - 1;
+            }
+            else {
+                geom->set_vertex_data(_bindings[it->second].data);
+            }
+            _bindings[binding_index[original]].geoms.push_back(std::make_pair(geom_node, (int)j));
+        }
+    }
+
+}
 
-                // We only want the default vertices once.
-                if (!captured_default_vertices) {
-                    vertex_object_space.clear();
+/*
+* Captures the default position and s,t,u of every point of every binding, and the
+* rest frames of every row.
+*
+* Rows with bit-identical positions (UV and normal seams, hard edges) are welded into
+* one point, so each position is only deformed once however many rows draw it.
+* Points are numbered in Morton order, see sort_points.
+*
+* Runs in stages on the thread pool, split by row range so that a single large
+* binding still uses every worker: read rows, weld each hash bucket, number the
+* welded points by counting per range and a prefix sum, then gather.
+*/
+void FreeFormDeform::capture_rest_vertices() {
+    size_t num_bindings = _bindings.size();
+    size_t num_buckets = std::min(std::max(_thread_pool->get_num_threads(), 1), 256);
 
-                    vertex_minus_min = vertex - _lattice->get_x0();
+    // Per binding, per row: the position, its hash bucket and the row it welds to.
+    struct RowScratch {
+        pvector<LPoint3f> positions;
+        pvector<unsigned char> buckets;
+        pvector<int> row_points;
+        pvector<int> point_of_row;
+    };
+    pvector<RowScratch> scratch(num_bindings);
 
-                    double s = (T.cross(U).dot(vertex_minus_min)) / T.cross(U).dot(S);
-                    double t = (S.cross(U).dot(vertex_minus_min)) / S.cross(U).dot(T);
-                    double u = (S.cross(T).dot(vertex_minus_min)) / S.cross(T).dot(U);
+    // (binding, first row) for each chunk, and the first chunk of each binding:
+    pvector<std::pair<size_t, size_t>> chunks;
+    pvector<size_t> binding_chunks(num_bindings + 1, 0);
+    for (size_t b = 0; b < num_bindings; b++) {
+        size_t num_rows = _bindings[b].data->get_num_rows();
+        for (size_t begin = 0; begin < num_rows; begin += _DEFORM_CHUNK_SIZE) {
+            chunks.push_back(std::make_pair(b, begin));
+        }
+        binding_chunks[b + 1] = chunks.size();
+    }
+    auto chunk_end = [&](size_t chunk) {
+        return std::min(chunks[chunk].second + _DEFORM_CHUNK_SIZE, scratch[chunks[chunk].first].positions.size());
+    };
 
-                    vertex_object_space.push_back(vertex);
-                    vertex_object_space.push_back(LPoint3f(s, t, u));
+    const char* columns[3] = { "normal", "tangent", "binormal" };
+    run_tasks(num_bindings, [&](size_t b, int) {
+        size_t num_rows = _bindings[b].data->get_num_rows();
+        scratch[b].positions.resize(num_rows);
+        scratch[b].buckets.resize(num_rows);
+        scratch[b].row_points.resize(num_rows);
+        scratch[b].point_of_row.resize(num_rows);
 
-                    _default_vertex_ws_os[geom_node].push_back(vertex_object_space);
-                }
+        // Rest frames, zero-filled where a column is missing so rows stay aligned:
+        RestFrames& frames = _bindings[b].rest_frames;
+        frames.normal.assign(num_rows, LVector3f(0));
+        frames.tangent.assign(num_rows, LVector3f(0));
+        frames.binormal.assign(num_rows, LVector3f(0));
+    });
 
-                // We do not care about vertices that aren't within our lattice.
-                if (!_lattice->point_in_range(_render.get_relative_point(_np, vertex))) {
-                    _non_influenced_vertex[geom_node].push_back(row);
-                    row++;
-                    continue;
-                }
+    // Read the positions and rest frames of each range of rows:
+    run_tasks(chunks.size(), [&](size_t chunk, int) {
+        Binding& binding = _bindings[chunks[chunk].first];
+        RowScratch& rows = scratch[chunks[chunk].first];
+        size_t begin = chunks[chunk].second, end = chunk_end(chunk);
 
-                // We're going to determine if this vertex is modified by a control point.
-                for (size_t ctrl_i = 0; ctrl_i < _lattice->get_num_control_points(); ctrl_i++) {
-                    influenced = is_influenced(ctrl_i, _default_vertex_ws_os[geom_node][row][1]);
-                    if (influenced) {
-                        _influenced_vertices[geom_node][ctrl_i].push_back(row);
-                    }
-                }
-                row++;
+        PositionKeyHash hash;
+        GeomVertexReader v_reader(binding.data, "vertex");
+        v_reader.set_row(begin);
+        for (size_t row = begin; row < end; row++) {
+            rows.positions[row] = v_reader.get_data3f();
+            rows.buckets[row] = (unsigned char)(hash(PositionKey(rows.positions[row])) % num_buckets);
+        }
+
+        pvector<LVector3f>* rest[3] = { &binding.rest_frames.normal, &binding.rest_frames.tangent,
+            &binding.rest_frames.binormal };
+        for (int c = 0; c < 3; c++) {
+            if (!binding.data->has_column(columns[c])) {
+                continue;
+            }
+            GeomVertexReader frame_reader(binding.data, columns[c]);
+            frame_reader.set_row(begin);
+            for (size_t row = begin; row < end; row++) {
+                (*rest[c])[row] = frame_reader.get_data3f();
+            }
+        }
+    });
+
+    // Weld: equal positions share a bucket, so each bucket finds the first row of its
+    // positions on its own.
+    run_tasks(num_bindings * num_buckets, [&](size_t task, int) {
+        RowScratch& rows = scratch[task / num_buckets];
+        unsigned char bucket = (unsigned char)(task % num_buckets);
+
+        std::unordered_map<PositionKey, int, PositionKeyHash> first_row;
+        for (size_t row = 0; row < rows.positions.size(); row++) {
+            if (rows.buckets[row] == bucket) {
+                std::pair<std::unordered_map<PositionKey, int, PositionKeyHash>::iterator, bool> inserted =
+                    first_row.insert(std::make_pair(PositionKey(rows.positions[row]), (int)row));
+                rows.row_points[row] = inserted.first->second;
             }
         }
-        _geom_nodes.push_back(geom_node);
+    });
+
+    // Points are the first rows of their position, numbered in row order:
+    pvector<int> chunk_points(chunks.size(), 0);
+    run_tasks(chunks.size(), [&](size_t chunk, int) {
+        const RowScratch& rows = scratch[chunks[chunk].first];
+        for (size_t row = chunks[chunk].second; row < chunk_end(chunk); row++) {
+            chunk_points[chunk] += rows.row_points[row] == (int)row;
+        }
+    });
+    for (size_t b = 0; b < num_bindings; b++) {
+        int num_points = 0;
+        for (size_t chunk = binding_chunks[b]; chunk < binding_chunks[b + 1]; chunk++) {
+            int count = chunk_points[chunk];
+            chunk_points[chunk] = num_points;
+            num_points += count;
+        }
+        DefaultVertices& default_vertices = _bindings[b].default_vertices;
+        default_vertices.x.resize(num_points);
+        default_vertices.y.resize(num_points);
+        default_vertices.z.resize(num_points);
+    }
+
+    run_tasks(chunks.size(), [&](size_t chunk, int) {
+        DefaultVertices& default_vertices = _bindings[chunks[chunk].first].default_vertices;
+        RowScratch& rows = scratch[chunks[chunk].first];
+        int point = chunk_points[chunk];
+        for (size_t row = chunks[chunk].second; row < chunk_end(chunk); row++) {
+            if (rows.row_points[row] == (int)row) {
+                default_vertices.x[point] = rows.positions[row][0];
+                default_vertices.y[point] = rows.positions[row][1];
+                default_vertices.z[point] = rows.positions[row][2];
+                rows.point_of_row[row] = point++;
+            }
+        }
+    });
+    run_tasks(chunks.size(), [&](size_t chunk, int) {
+        RowScratch& rows = scratch[chunks[chunk].first];
+        for (size_t row = chunks[chunk].second; row < chunk_end(chunk); row++) {
+            rows.row_points[row] = rows.point_of_row[rows.row_points[row]];
+        }
+    });
+
+    run_tasks(num_bindings, [&](size_t b, int) {
+        capture_parameters(_bindings[b]);
+        sort_points(_bindings[b], scratch[b].row_points);
+        build_point_rows(_bindings[b], scratch[b].row_points);
+    });
+}
+
+/*
+* Builds the point -> rows index of <binding> from <row_points> (row -> point), by
+* counting sort so each point's rows stay in order.
+*/
+void FreeFormDeform::build_point_rows(Binding& binding, const pvector<int>& row_points) {
+    size_t num_points = binding.default_vertices.x.size();
+    binding.point_row_offsets.assign(num_points + 1, 0);
+    for (int point : row_points) {
+        binding.point_row_offsets[point + 1]++;
+    }
+    for (size_t point = 0; point < num_points; point++) {
+        binding.point_row_offsets[point + 1] += binding.point_row_offsets[point];
+    }
+    binding.point_rows.resize(row_points.size());
+    pvector<int> cursor(binding.point_row_offsets.begin(), binding.point_row_offsets.end() - 1);
+    for (size_t row = 0; row < row_points.size(); row++) {
+        binding.point_rows[cursor[row_points[row]]++] = (int)row;
+    }
+}
+
+/*
+* Renumbers the points of <binding> in Morton order of their s,t,u, and <row_points>
+* (row -> point) with them. Called at bind time and whenever s,t,u are recomputed.
+*
+* Every point list (the influence index, its selection unions, deformation chunks) is
+* sorted by point, so this makes them walk the lattice in spatially coherent tiles:
+* neighbouring points share basis rows and control points, and their written rows
+* tend to share cache lines.
+*/
+void FreeFormDeform::sort_points(Binding& binding, pvector<int>& row_points) {
+    DefaultVertices& default_vertices = binding.default_vertices;
+    ParameterStreams& parameters = default_vertices.parameters;
+    size_t num_points = default_vertices.x.size();
+
+    // (key, old index), so ties keep their capture order:
+    pvector<std::pair<uint32_t, int>> keys(num_points);
+    for (size_t point = 0; point < num_points; point++) {
+        keys[point] = std::make_pair(morton_key(parameters.s[point], parameters.t[point], parameters.u[point]), (int)point);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    pvector<int> new_index(num_points);
+    pvector<float>* streams[6] = { &default_vertices.x, &default_vertices.y, &default_vertices.z,
+        &parameters.s, &parameters.t, &parameters.u };
+    pvector<float> sorted(num_points);
+    for (int i = 0; i < 6; i++) {
+        for (size_t point = 0; point < num_points; point++) {
+            sorted[point] = (*streams[i])[keys[point].second];
+        }
+        streams[i]->swap(sorted);
+    }
+
+    for (size_t point = 0; point < num_points; point++) {
+        new_index[keys[point].second] = (int)point;
+    }
+    for (int& point : row_points) {
+        point = new_index[point];
+    }
+}
+
+/*
+* (Re)computes the s,t,u of every point of <binding>: one affine transform by
+* _parameter_mat over the position streams, which the compiler can vectorize.
+*/
+void FreeFormDeform::capture_parameters(Binding& binding) {
+    const DefaultVertices& default_vertices = binding.default_vertices;
+    ParameterStreams& parameters = binding.default_vertices.parameters;
+    size_t num_points = default_vertices.x.size();
+
+    parameters.s.resize(num_points);
+    parameters.t.resize(num_points);
+    parameters.u.resize(num_points);
+
+    const float* x = default_vertices.x.data();
+    const float* y = default_vertices.y.data();
+    const float* z = default_vertices.z.data();
+    float* out[3] = { parameters.s.data(), parameters.t.data(), parameters.u.data() };
+
+    for (int c = 0; c < 3; c++) {
+        float m0 = _parameter_mat(0, c), m1 = _parameter_mat(1, c);
+        float m2 = _parameter_mat(2, c), m3 = _parameter_mat(3, c);
+        float* stream = out[c];
+        for (size_t point = 0; point < num_points; point++) {
+            stream[point] = x[point] * m0 + y[point] * m1 + z[point] * m2 + m3;
+        }
     }
-    captured_default_vertices = true;
 }
 
 
@@ -356,18 +1799,22 @@ void FreeFormDeform::process_node() {
 */
 std::ostream& operator<<(std::ostream& os, FreeFormDeform& obj) {
     os << "FreeFormDeform:\n";
-    os << " # _geom_nodes: " << obj._geom_nodes.size() << "\n";
-    os << " # _influenced_vertices[k]: " << obj._influenced_vertices.size() << "\n";
-    for (GeomNode* g_n : obj._geom_nodes) {
-        os << "  " << obj._influenced_vertices[g_n].size() << "\n";
-    }
-    os << " # _non_influenced_vertex: " << obj._non_influenced_vertex.size() << "\n";
-    for (GeomNode* g_n : obj._geom_nodes) {
-        os << "  " << obj._non_influenced_vertex[g_n].size() << "\n";
-    }
-    os << " # _default_vertex_ws_os: " << obj._default_vertex_ws_os.size() << "\n";
-    for (GeomNode* g_n : obj._geom_nodes) {
-        os << "  " << obj._default_vertex_ws_os[g_n].size() << "\n";
+    os << " # _bindings: " << obj._bindings.size() << "\n";
+    for (FreeFormDeform::Binding& binding : obj._bindings) {
+        os << "  geoms: " << binding.geoms.size()
+            << ", rows: " << binding.point_rows.size()
+            << ", points: " << binding.default_vertices.x.size()
+            << ", influenced: " << binding.influence.get_all_vertices().size()
+            << ", non-influenced: " << binding.non_influenced.size()
+            << ", weights: " << binding.weights.get_num_weights() << "\n";
+    }
+    os << " # threads: " << obj.get_num_threads() << "\n";
+    os << " # _tune_results: " << obj._tune_results.size() << "\n";
+    for (size_t i = 0; i < obj._tune_results.size(); i++) {
+        const FreeFormDeform::TuneResult& result = obj._tune_results[i];
+        os << ((int)i == obj._tune_choice ? "* " : "  ") << result.path << " "
+            << DEFORM_KERNEL::get_instruction_set_name(result.instruction_set) << " x"
+            << result.num_threads << ": " << result.seconds * 1000.0 << " ms, error " << result.error << "\n";
     }
     os << " # _v_n_comb_table: " << obj._v_n_comb_table.size() << "\n";
     os << " # _selected_points: " << obj._selected_points.size() << "\n";
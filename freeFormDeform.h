@@ -10,42 +10,163 @@
 #include "pandaFramework.h"
 #include "mouseWatcher.h"
 #include "camera.h"
+#include "genericAsyncTask.h"
+#include "asyncTaskManager.h"
 
 #include "lattice.h"
 #include "objectHandles.h"
+#include "weightMatrix.h"
+#include "influenceIndex.h"
+#include "deformKernel.h"
+#include "fixedDegreeKernel.h"
+#include "deformThreadPool.h"
+#include "deformationGrid.h"
 
 class FreeFormDeform {
 public:
-    FreeFormDeform(NodePath np, NodePath render);
+    enum DeformPath {
+        DP_weights,     // Sparse product of the cached weights and control points.
+        DP_vectorized,  // Batched SIMD evaluation of the (s,t,u) streams.
+        DP_grid,        // Approximate; trilinear interpolation of a DeformationGrid.
+    };
+
+    // One back-end measured by tune().
+    struct TuneResult {
+        DeformPath path;
+        DEFORM_KERNEL::InstructionSet instruction_set;
+        int num_threads;
+        double seconds; // Estimated time of a full update of every bound vertex.
+        double error;   // Largest distance from the exact map over the sampled vertices.
+    };
+
+    FreeFormDeform(NodePath np, NodePath render, bool async = false);
     inline ~FreeFormDeform();
 
+    inline bool is_ready() const;
+    inline void wait_ready();
+    inline const std::string& get_ready_event() const;
+
     inline void set_edge_spans(int size_x, int size_y, int size_z);
+    inline void set_basis_type(Lattice::BasisType basis_type);
+
+    inline void set_flat_axis(int axis);
+    inline int get_flat_axis() const;
+
+    inline void set_lattice_frame(const LMatrix4f& frame);
+    inline const LMatrix4f& get_lattice_frame() const;
+    void fit_lattice_frame();
+
+    inline void set_deform_path(DeformPath path);
+    inline DeformPath get_deform_path() const;
+
+    inline void set_instruction_set(DEFORM_KERNEL::InstructionSet instruction_set);
+    inline DEFORM_KERNEL::InstructionSet get_instruction_set() const;
+
+    inline void set_num_threads(int num_threads);
+    inline int get_num_threads() const;
+
+    inline void set_incremental(bool incremental);
+    inline bool is_incremental() const;
+    inline void set_anchor_interval(int interval);
+    inline int get_anchor_interval() const;
+
+    inline void set_deform_normals(bool deform_normals);
+    inline bool get_deform_normals() const;
+
+    inline void set_grid_resolution(int resolution);
+    inline int get_grid_resolution() const;
+    double estimate_grid_error();
+
+    void tune();
+    inline void set_auto_tune(bool auto_tune);
+    inline bool get_auto_tune() const;
+    inline void set_tune_max_error(double max_error);
+    inline double get_tune_max_error() const;
+    inline const pvector<TuneResult>& get_tune_results() const;
+    inline int get_tune_choice() const;
+
+    inline void set_weight_tolerance(double tolerance);
+    inline double get_weight_tolerance() const;
+    inline double get_weight_error() const;
+
+    void deform_points(const float* in, size_t in_stride, float* out, size_t out_stride, size_t count);
 
     void process_node();
     void update_vertices(bool force = false);
-    void reset_vertices(GeomVertexData* data, GeomNode* geom_node, std::vector<int>& indices);
     
     Lattice& get_lattice();
 
     static void handle_drag(const Event* e, void* args);
+    static AsyncTask::DoneStatus bind_task(GenericAsyncTask* task, void* args);
+    static void handle_ready(const Event* e, void* args);
+    static AsyncTask::DoneStatus settle_task(GenericAsyncTask* task, void* args);
 
     friend std::ostream& operator<<(std::ostream& os, FreeFormDeform& obj);
 
 private:
-    void transform_vertex(GeomVertexData* data, GeomNode* geom_node, std::vector<int>& control_points);
-    void transform_all_influenced(GeomVertexData* data, GeomNode* geom_node);
+    struct Binding;
+
+    void transform_vertex(Binding& binding, std::vector<int>& control_points);
+    void transform_all_influenced(Binding& binding);
+    void reset_vertices(Binding& binding);
+    void evaluate_exact(const float* s, const float* t, const float* u, size_t count,
+        const LVecBase4f* control_points, LPoint3f* out, int worker = 0);
+    void update_grid();
+    void queue_points(Binding& binding, const pvector<int>& points);
+    void run_jobs();
+    bool apply_control_point_deltas(std::vector<int>& control_points);
+    void anchor_deformed_positions();
     void populate_lookup_table();
+    void capture_parameterization();
+    void compose_parameterization();
+    void rebind_parameters();
+    void reparameterize();
+    void capture_default_vertices();
+    void bind_vertices();
+    void classify_points();
+    void capture_rest_vertices();
+    void capture_parameters(Binding& binding);
+    void sort_points(Binding& binding, pvector<int>& row_points);
+    void build_point_rows(Binding& binding, const pvector<int>& row_points);
+    void build_weights(bool retune = true);
+    void schedule_settle();
 
-    inline int binomial_coeff(int n, int k);
-    inline double bernstein(double v, int i, double n, double x);
+    inline void bernstein_row(int axis, double x, double* out);
+    inline void bernstein_derivative_row(int axis, double x, double* out);
+    inline void bspline_row(int axis, double x, double* out, bool derivative = false);
+    inline void basis_rows(const LPoint3f& stu, pvector<double>* rows);
+    inline void basis_derivative_rows(const LPoint3f& stu, pvector<double>* rows);
+    inline void basis_support(int axis, double x, int& begin, int& end);
 
-    double factorial(double n);
-    bool is_influenced(int index, LVector3f stu);
     int get_point_index(int i, int j, int k);
     std::vector<int> get_ijk(int index);
 
     bool captured_default_vertices = false;
 
+    // Inputs of the last process_node; it only rebinds when one of them changed.
+    // Only the lattice relative to the model counts, so rigid motion of both is free.
+    // Changes below _BIND_TOLERANCE of the lattice extent are float noise.
+    LMatrix4f _bound_lattice_mat;
+    const float _BIND_TOLERANCE = 1e-5f;
+    bool _binding_dirty = true;
+
+    // Set whenever the binding changed since the last update_vertices.
+    bool _deformation_stale = true;
+
+    // A relative move waiting for settle_task to rebind it.
+    PT(GenericAsyncTask) _settle_task;
+    bool _reparameterize_pending = false;
+    bool _moved_since_settle = false;
+    const double _SETTLE_DELAY = 0.1; // Seconds without a relative move.
+
+    // Control point buffer the vertices were last deformed for, up to _BIND_TOLERANCE.
+    pvector<LVecBase4f> _deformed_control_points;
+
+    // Asynchronous construction, see the constructor.
+    PT(GenericAsyncTask) _bind_task;
+    std::string _ready_event;
+    static int _next_bind_id;
+
     NodePath _np;
     NodePath _render;
     NodePath _top_node;
@@ -53,21 +174,126 @@ private:
 
     LVector3f deform_vertex(double s, double t, double u);
 
-    pvector<PT(GeomNode)> _geom_nodes;
+    // (s,t,u) as structure-of-arrays streams.
+    struct ParameterStreams {
+        pvector<float> s, t, u;
+    };
+
+    // Rest position and (s,t,u) of every point, one flat array per component.
+    struct DefaultVertices {
+        pvector<float> x, y, z;
+        ParameterStreams parameters;
+    };
+
+    // Rest "normal", "tangent" and "binormal" per row (zero if the column is missing).
+    struct RestFrames {
+        pvector<LVector3f> normal, tangent, binormal;
+    };
+    bool _deform_normals = false;
+
+    // Everything bound to one unique GeomVertexData.
+    //
+    // Rows sharing a rest position (seams) are welded into one point. Points are what
+    // gets deformed; the result is then scattered to each of their rows.
+    struct Binding {
+        PT(GeomVertexData) data;
+
+        // Every (GeomNode, geom index) drawing <data>.
+        pvector<std::pair<PT(GeomNode), int>> geoms;
+
+        // Point p is drawn by [point_row_offsets[p], point_row_offsets[p + 1]) of point_rows.
+        pvector<int> point_row_offsets;
+        pvector<int> point_rows;
+
+        DefaultVertices default_vertices;
+
+        // Per row; welded rows may still have different frames.
+        RestFrames rest_frames;
+
+        // Sparse (point x control point) basis weights.
+        WeightMatrix weights;
+
+        // Control point <-> influenced point index, and the points outside of the lattice.
+        InfluenceIndex influence;
+        pvector<int> non_influenced;
+
+        // Weights * control points for every point, kept current by
+        // apply_control_point_deltas when incremental updates are enabled.
+        pvector<LPoint3f> deformed_positions;
+    };
+    pvector<Binding> _bindings;
+
+    // Vertex -> (s,t,u) as of the bind: the inverse of the lattice frame [S; T; U; x0].
+    // Its upper 3x3 is d(s,t,u)/d(vertex), with column k holding the gradient of s, t or u.
+    LMatrix4f _parameter_mat;
+
+    // The rest lattice frame [S; T; U; x0] as of the bind, in the lattice's own space.
+    LMatrix4f _rest_frame;
+
+    inline LPoint3f get_parameters(const LPoint3f& point) const;
+    inline float get_lattice_extent() const;
+
+    // Weights below this fraction are pruned at bind time (0 keeps every non-zero weight).
+    double _weight_tolerance = 0.0;
+
+    // Worst-case positional error introduced by pruning, in units of the deformation space.
+    double _weight_error = 0.0;
+
+    DeformPath _deform_path = DP_weights;
+
+    // Samples of the FFD map for DP_grid, and their (s,t,u).
+    DeformationGrid _grid;
+    ParameterStreams _grid_parameters;
+    bool _grid_dirty = true;
+    DEFORM_KERNEL::InstructionSet _instruction_set = DEFORM_KERNEL::get_best_instruction_set();
+
+    // Points of one binding queued for deformation, and their results.
+    struct DeformJob {
+        const Binding* binding;
+        pvector<int> points;
+        pvector<LPoint3f> positions;
+
+        // Three Jacobian columns per point, only filled if normals are deformed.
+        pvector<LVector3f> jacobians;
+    };
+    pvector<DeformJob> _jobs;
+
+    void evaluate_jobs(pvector<DeformJob>& jobs);
+    void evaluate_points(DeformJob& job, size_t begin, size_t end, int worker);
+    void evaluate_points_with_jacobians(DeformJob& job, size_t begin, size_t end);
+    void write_frames(const DeformJob& job);
+
+    DeformThreadPool* _thread_pool;
+    int _num_threads = 0; // Cap on the pool's workers for this instance; 0 for all.
+    inline void run_tasks(size_t num_tasks, const DeformThreadPool::TaskFunction& function);
+    const size_t _DEFORM_CHUNK_SIZE = 4096;
+
+    bool _incremental = false;
+    bool _anchored = false;
+    int _anchor_interval = 64;
+    int _updates_since_anchor = 0;
 
-    // GeomNode -> {c_point : [vertex..]}
-    typedef pmap<int, pvector<int>> __internal_vertices;
-    pmap<PT(GeomNode), __internal_vertices> _influenced_vertices;
+    // Auto-tuning, see tune().
+    bool _auto_tune = false;
+    double _tune_max_error = 0.001;
+    pvector<TuneResult> _tune_results;
+    int _tune_choice = -1;
+    const size_t _TUNE_SAMPLE_ROWS = 65536;
+    const int _TUNE_REPETITIONS = 3;
+    const float _TUNE_JITTER = 0.25f; // Of a lattice cell.
 
-    // GeomNode -> [not-influenced-vertex]
-    pmap<PT(GeomNode), pvector<int>> _non_influenced_vertex;
+    // Per-worker scratch for the vectorized path, deform_points and evaluate_exact.
+    struct BasisRows {
+        pvector<double> rows[3];
+    };
+    pvector<ParameterStreams> _worker_scratch;
+    pvector<pvector<LPoint3f>> _worker_points;
+    pvector<BasisRows> _worker_basis;
 
-    // GeomNode -> [[default_vertex_world_space, default_vertex_object_space]]
-    typedef pvector<pvector<LPoint3f>> __internal_default_vertices_pos;
-    pmap<PT(GeomNode), __internal_default_vertices_pos> _default_vertex_ws_os; // Default vertex, default object space vertex.
+    void reserve_worker_scratch();
 
-    // Lookup Table for binomial_coeff(n,v).
-    std::vector<std::vector<int>> _v_n_comb_table;
+    // Lookup Table for C(n,v), exact 64-bit coefficients per axis.
+    std::vector<std::vector<uint64_t>> _v_n_comb_table;
 
     ObjectHandles* _object_handles;
     pvector<int> _selected_points;
@@ -0,0 +1,103 @@
+#include "influenceIndex.h"
+
+#include <algorithm>
+
+/*
+* Rebuilds both directions from the non-zero weights of the given <rows> of <weights>.
+* Rows not listed (outside of the lattice) or without a weight are influenced by nothing.
+*/
+void InfluenceIndex::build(const WeightMatrix& weights, const pvector<int>& rows, int num_control_points) {
+    size_t num_rows = weights.get_num_rows();
+
+    _unions.clear();
+    _stamps.assign(num_rows, 0);
+    _stamp = 1;
+
+    // Influenced rows, sorted and without duplicates:
+    _all_vertices.clear();
+    for (int row : rows) {
+        if (_stamps[row] != _stamp && weights.get_row_end(row) > weights.get_row_begin(row)) {
+            _stamps[row] = _stamp;
+            _all_vertices.push_back(row);
+        }
+    }
+    std::sort(_all_vertices.begin(), _all_vertices.end());
+
+    // Row -> control points is the column pattern of the influenced rows:
+    _row_offsets.assign(num_rows + 1, 0);
+    for (int row : _all_vertices) {
+        _row_offsets[row + 1] = weights.get_row_end(row) - weights.get_row_begin(row);
+    }
+    for (size_t row = 0; row < num_rows; row++) {
+        _row_offsets[row + 1] += _row_offsets[row];
+    }
+
+    _control_points.resize(_row_offsets.back());
+    _column_offsets.assign(num_control_points + 1, 0);
+    for (int row : _all_vertices) {
+        int dest = _row_offsets[row];
+        for (int w = weights.get_row_begin(row); w < weights.get_row_end(row); w++) {
+            _control_points[dest++] = weights.get_column(w);
+            _column_offsets[weights.get_column(w) + 1]++;
+        }
+    }
+
+    // Control point -> rows, by counting sort. Rows are visited in order so each stays sorted.
+    for (int c = 0; c < num_control_points; c++) {
+        _column_offsets[c + 1] += _column_offsets[c];
+    }
+    _vertices.resize(_column_offsets.back());
+
+    pvector<int> cursor(_column_offsets.begin(), _column_offsets.end() - 1);
+    for (int row : _all_vertices) {
+        for (int i = _row_offsets[row]; i < _row_offsets[row + 1]; i++) {
+            _vertices[cursor[_control_points[i]]++] = row;
+        }
+    }
+}
+
+/*
+* Returns every row influenced by at least one of <control_points>, sorted.
+* Selections are merged once and cached; dragging the same selection again only
+* costs the lookup.
+*/
+const pvector<int>& InfluenceIndex::get_vertices(const std::vector<int>& control_points) {
+    _selection.assign(control_points.begin(), control_points.end());
+    std::sort(_selection.begin(), _selection.end());
+    _selection.erase(std::unique(_selection.begin(), _selection.end()), _selection.end());
+
+    pmap<pvector<int>, pvector<int>>::iterator it = _unions.find(_selection);
+    if (it != _unions.end()) {
+        return it->second;
+    }
+
+    if (_unions.size() >= _MAX_UNIONS) {
+        _unions.clear();
+    }
+    pvector<int>& vertices = _unions[_selection];
+
+    // Stamp instead of hashing; the stamp only has to be reset when it wraps around.
+    if (++_stamp == 0) {
+        std::fill(_stamps.begin(), _stamps.end(), 0);
+        _stamp = 1;
+    }
+
+    for (int control_point : _selection) {
+        if (control_point < 0 || control_point >= get_num_control_points()) {
+            continue;
+        }
+        for (int i = _column_offsets[control_point]; i < _column_offsets[control_point + 1]; i++) {
+            int row = _vertices[i];
+            if (_stamps[row] != _stamp) {
+                _stamps[row] = _stamp;
+                vertices.push_back(row);
+            }
+        }
+    }
+
+    // A single control point's rows are sorted already.
+    if (_selection.size() > 1) {
+        std::sort(vertices.begin(), vertices.end());
+    }
+    return vertices;
+}
@@ -0,0 +1,64 @@
+#ifndef INFLUENCE_INDEX_H
+#define INFLUENCE_INDEX_H
+
+#include "pmap.h"
+#include "pvector.h"
+
+#include "weightMatrix.h"
+
+/*
+* Which vertices (rows) each control point influences and vice versa, restricted to
+* the rows within the lattice. Both directions are stored in compressed sparse row
+* form and built once per bind, so looking up the vertices of a selection needs no
+* hashing. Unions of multi-point selections are computed with a row stamp and cached,
+* since the same selection is usually dragged for many frames.
+*/
+class InfluenceIndex {
+public:
+    inline InfluenceIndex();
+
+    void build(const WeightMatrix& weights, const pvector<int>& rows, int num_control_points);
+
+    inline size_t get_num_rows() const;
+    inline int get_num_control_points() const;
+
+    // Control point -> rows, each sorted.
+    inline int get_vertices_begin(int control_point) const;
+    inline int get_vertices_end(int control_point) const;
+    inline int get_vertex(int i) const;
+
+    // Row -> control points.
+    inline int get_control_points_begin(size_t row) const;
+    inline int get_control_points_end(size_t row) const;
+    inline int get_control_point(int i) const;
+
+    inline const pvector<int>& get_all_vertices() const;
+    const pvector<int>& get_vertices(const std::vector<int>& control_points);
+
+private:
+    // Control point c spans [_column_offsets[c], _column_offsets[c + 1]) of _vertices.
+    pvector<int> _column_offsets;
+    pvector<int> _vertices;
+
+    // Row r spans [_row_offsets[r], _row_offsets[r + 1]) of _control_points.
+    pvector<int> _row_offsets;
+    pvector<int> _control_points;
+
+    // Every influenced row, sorted.
+    pvector<int> _all_vertices;
+
+    // Sorted selection -> sorted union of its rows. Cleared once it holds _MAX_UNIONS.
+    pmap<pvector<int>, pvector<int>> _unions;
+    const size_t _MAX_UNIONS = 32;
+
+    // Scratch for the sorted selection being looked up.
+    pvector<int> _selection;
+
+    // _stamps[row] == _stamp marks a row already in the union being built.
+    pvector<unsigned int> _stamps;
+    unsigned int _stamp = 0;
+};
+
+#include "influenceIndex.I"
+
+#endif
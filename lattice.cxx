@@ -25,14 +25,19 @@ void Lattice::create_control_points(const double radius) {
 
     LPoint3f point;
 
+    // A single layer (span 0) sits in the middle of its axis:
+    auto fraction = [](int index, int span) {
+        return span > 0 ? (double)index / span : 0.5;
+    };
+
+    // x0 + (i/l)S + (j/m)T + (k/n)U; S, T, U need not be axis-aligned.
     for (size_t i = 0; i <= _plane_spans[0]; i++) {
         for (size_t j = 0; j <= _plane_spans[1]; j++) {
             for (size_t k = 0; k <= _plane_spans[2]; k++) {
-                point = LPoint3f(
-                    _x0[0] + ((double)i / _plane_spans[0]) * _lattice_vecs[0][0],
-                    _x0[1] + ((double)k / _plane_spans[2]) * _lattice_vecs[2][1],
-                    _x0[2] + ((double)j / _plane_spans[1]) * _lattice_vecs[1][2]
-                );
+                point = _x0 +
+                    _lattice_vecs[0] * fraction(i, _plane_spans[0]) +
+                    _lattice_vecs[1] * fraction(j, _plane_spans[1]) +
+                    _lattice_vecs[2] * fraction(k, _plane_spans[2]);
                 create_point(point, radius, i, j, k);
             }
         }
@@ -264,6 +269,32 @@ void Lattice::update_edges(int index) {
     LINESEGS_EXT::update_lines(_edges, _edgesNp);
 }
 
+/*
+* Resolves every control point into the space of <other> and stores them in
+* _control_point_buffer. See resolve_control_points.
+*
+* The buffer it replaces is kept as the previous buffer.
+*/
+void Lattice::update_control_point_buffer(const NodePath& other) {
+    _previous_control_point_buffer.swap(_control_point_buffer);
+    resolve_control_points(other, _control_point_buffer);
+}
+
+/*
+* Resolves every control point into the space of <other> into <out>, leaving the
+* control point buffers alone. Control points are direct children of the Lattice,
+* so this composes one relative transform and applies it to each local position
+* instead of doing a scene-graph lookup per point.
+*/
+void Lattice::resolve_control_points(const NodePath& other, pvector<LVecBase4f>& out) const {
+    LMatrix4f mat = get_mat(other);
+
+    out.resize(_control_points.size());
+    for (size_t i = 0; i < _control_points.size(); i++) {
+        out[i] = LVecBase4f(mat.xform_point(_control_points[i].get_pos()), 1.0f);
+    }
+}
+
 /*
 * Completely resets all maps, vectors, and variables related to edges.
 * Removes _edgesNp and resets the LineSegs instance.
@@ -310,6 +341,7 @@ void Lattice::create_point(LPoint3f point, const double radius, int i, int j, in
 
 /*
 * Sets the edge spans to the given x, y, z.
+* The span of the flat axis (see set_flat_axis) stays 0.
 * Rebuilds Lattice automatically.
 */
 void Lattice::set_edge_spans(int size_x, int size_y, int size_z) {
@@ -317,6 +349,46 @@ void Lattice::set_edge_spans(int size_x, int size_y, int size_z) {
     _plane_spans.push_back(size_x);
     _plane_spans.push_back(size_y);
     _plane_spans.push_back(size_z);
+    if (is_flat()) {
+        _flat_axis_span = _plane_spans[_flat_axis];
+        _plane_spans[_flat_axis] = 0;
+    }
+    rebuild();
+}
+
+/*
+* Makes the lattice bivariate: the given s (0), t (1) or u (2) axis gets a single layer
+* of control points, so there are (l+1)(m+1) of them and every kernel skips that axis.
+* Geometry is projected onto the layer, which is what flat geometry (cards, UI, decals)
+* wants anyway. -1 makes the lattice trivariate again; an axis the geometry has no
+* extent along then spans a unit length centred on it.
+*
+* Geometry whose bounds are flat along an axis is detected when the lattice is first
+* built. Rebuilds Lattice automatically.
+*/
+void Lattice::set_flat_axis(int axis) {
+    if (is_flat()) {
+        _plane_spans[_flat_axis] = _flat_axis_span;
+    }
+    _flat_axis = axis;
+    if (is_flat()) {
+        _flat_axis_span = _plane_spans[_flat_axis];
+        _plane_spans[_flat_axis] = 0;
+    }
+    rebuild();
+}
+
+/*
+* Orients the lattice box: <frame> is a rotation relative to the top node whose rows
+* are the directions of the lattice's x, y and z (s, u and t). The box is refitted to
+* the NodePath's tight bounds in that frame, which hugs rotated assets far closer than
+* an axis-aligned box. The identity matrix makes the lattice axis-aligned again.
+* Rebuilds Lattice automatically.
+*/
+void Lattice::set_frame(const LMatrix4f& frame) {
+    _frame = frame;
+    _oriented = frame != LMatrix4f::ident_mat();
+    initial_bounds_capture = false;
     rebuild();
 }
 
@@ -328,16 +400,43 @@ void Lattice::set_edge_spans(int size_x, int size_y, int size_z) {
 * This is so we can properly set our control points without actually parenting
 * them to something. It also is a workaround a "jerky" motion the control points
 * will do at times.
+*
+* Oriented lattices (see set_frame) take the bounds in their frame; x0, x1 and
+* S, T, U are then transformed back out of it.
 */
 void Lattice::calculate_lattice_vec() {
     _lattice_vecs.clear();
     LPoint3f delta(0.0);
+
+    NodePath frame_np;
+    if (_oriented) {
+        frame_np = _np.get_top().attach_new_node("lattice_frame");
+        frame_np.set_mat(_frame);
+    }
+
     if (!initial_bounds_capture) {
-        _np.calc_tight_bounds(_x0, _x1);
+        if (_oriented) {
+            _np.calc_tight_bounds(_x0, _x1, frame_np);
+        }
+        else {
+            _np.calc_tight_bounds(_x0, _x1);
+        }
         initial_bounds_capture = true;
+
+        // Flat geometry gets a bivariate lattice; s, t, u are x, z, y.
+        LVector3f size = _x1 - _x0;
+        double largest = std::max(size[0], std::max(size[1], size[2]));
+        int axes[3] = { 0, 2, 1 };
+        for (int axis = 0; axis < 3 && !is_flat(); axis++) {
+            if (largest > 0.0 && size[axes[axis]] <= largest * 1e-5) {
+                _flat_axis = axis;
+                _flat_axis_span = _plane_spans[axis];
+                _plane_spans[axis] = 0;
+            }
+        }
     }
     else {
-        _edgesNp.calc_tight_bounds(_x0, _x1, _np.get_top());
+        _edgesNp.calc_tight_bounds(_x0, _x1, _oriented ? frame_np : _np.get_top());
         _edgesNp.show_tight_bounds();
 
         delta = _edgesNp.get_pos(_np.get_top()) - _edge_pos;
@@ -358,6 +457,33 @@ void Lattice::calculate_lattice_vec() {
     LVector3f s = LVector3f(size_s, 0, 0);
     LVector3f t = LVector3f(0, 0, size_t);
     LVector3f u = LVector3f(0, size_u, 0);
+
+    // An axis with no extent (a planar card) gets a unit length centred on the
+    // geometry, so its single layer of control points sits on the plane itself.
+    LVector3f pad(0, 0, 0);
+    if (size_s == 0.0) {
+        s = LVector3f(1, 0, 0);
+        pad[0] = 0.5f;
+    }
+    if (size_t == 0.0) {
+        t = LVector3f(0, 0, 1);
+        pad[2] = 0.5f;
+    }
+    if (size_u == 0.0) {
+        u = LVector3f(0, 1, 0);
+        pad[1] = 0.5f;
+    }
+    _x0 -= pad;
+    _x1 += pad;
+
+    if (_oriented) {
+        _x0 = _frame.xform_point(_x0);
+        _x1 = _frame.xform_point(_x1);
+        s = _frame.xform_vec(s);
+        t = _frame.xform_vec(t);
+        u = _frame.xform_vec(u);
+        frame_np.remove_node();
+    }
     
     _lattice_vecs.push_back(s);
     _lattice_vecs.push_back(t);
@@ -414,6 +540,8 @@ std::ostream& operator<<(std::ostream& os, Lattice& obj) {
     os << " # _point_ijk_map: " << obj._point_ijk_map.size() << "\n";
     os << " # _selected_control_points: " << obj._selected_control_points.size() << "\n";
     os << " Edge Spans: [" << obj.get_edge_spans()[0] << ", " << obj.get_edge_spans()[1] << ", " << obj.get_edge_spans()[2] << "]\n";
+    os << " Flat Axis: " << obj.get_flat_axis() << "\n";
+    os << " Oriented: " << obj.is_oriented() << "\n";
     os << " x0:" << obj.get_x0() << "\n";
     os << " x1:" << obj.get_x1() << "\n";
     return os;
@@ -2,6 +2,7 @@
 #define LATTICE_H
 
 #include "geomVertexData.h"
+#include "lvecBase4.h"
 #include "nodePath.h"
 #include "loader.h"
 #include "boundingSphere.h"
@@ -14,6 +15,12 @@
 
 class Lattice : public NodePath, public DraggableObject {
 public:
+    // Basis used to blend the control points.
+    enum BasisType {
+        BT_bernstein,  // Sederberg/Parry; every control point influences every interior vertex.
+        BT_bspline,    // Uniform cubic B-spline; a vertex depends on its 4x4x4 neighborhood only.
+    };
+
     inline Lattice(NodePath np);
     inline ~Lattice();
 
@@ -25,12 +32,30 @@ public:
     void set_edge_spans(int size_x, int size_y, int size_z);
     inline std::vector<int>& get_edge_spans();
 
+    inline void set_basis_type(BasisType basis_type);
+    inline BasisType get_basis_type() const;
+
+    void set_flat_axis(int axis);
+    inline int get_flat_axis() const;
+    inline bool is_flat() const;
+
+    void set_frame(const LMatrix4f& frame);
+    inline const LMatrix4f& get_frame() const;
+    inline bool is_oriented() const;
+
     void set_control_point_pos(LPoint3f pos, int index);
     inline NodePath& get_control_point(int index);
-    inline LPoint3f &get_control_point_pos(int i, const NodePath& other);
+    inline LPoint3f get_control_point_pos(int i, const NodePath& other);
     inline int get_num_control_points();
     inline std::vector<int>& get_selected_control_points();
 
+    void update_control_point_buffer(const NodePath& other);
+    void resolve_control_points(const NodePath& other, pvector<LVecBase4f>& out) const;
+    inline const pvector<LVecBase4f>& get_control_point_buffer() const;
+    inline pvector<LVecBase4f>& modify_control_point_buffer();
+    inline const pvector<LVecBase4f>& get_previous_control_point_buffer() const;
+    inline bool has_control_point_buffer_changed() const;
+
     inline bool point_in_range(LPoint3f& point);
 
     inline LPoint3f get_x0() const;
@@ -59,8 +84,24 @@ private:
     DraggableObjectManager* _dom = DraggableObjectManager::get_global_ptr();
 
     pvector<NodePath> _control_points; // P(ijk)
+
+    // P(ijk) relative to the deformation space (the deformed model), resolved once per update (w = 1).
+    pvector<LVecBase4f> _control_point_buffer;
+
+    // _control_point_buffer as of the update before.
+    pvector<LVecBase4f> _previous_control_point_buffer;
     pvector<LVector3f> _lattice_vecs; // STU
     std::vector<int> _plane_spans = { 2, 3, 2 }; // lnm
+    BasisType _basis_type = BT_bernstein;
+
+    // s, t or u axis collapsed to a single layer of control points (span 0), -1 if none.
+    int _flat_axis = -1;
+    int _flat_axis_span = 2; // Restored when the lattice is no longer flat.
+
+    // Orientation of the lattice box relative to the top node; its rows are the
+    // directions of x, y and z (s, u and t). Identity for an axis-aligned lattice.
+    LMatrix4f _frame = LMatrix4f::ident_mat();
+    bool _oriented = false;
 
     LPoint3f _x0, _x1;
 
@@ -0,0 +1,42 @@
+#include "weightMatrix.h"
+
+/*
+* Appends every row of <other> after the rows of this matrix. Rows built
+* separately (e.g. in parallel) are joined this way before build_columns.
+*/
+void WeightMatrix::append(const WeightMatrix& other) {
+    int base = _row_offsets.back();
+    for (size_t row = 1; row < other._row_offsets.size(); row++) {
+        _row_offsets.push_back(base + other._row_offsets[row]);
+    }
+    _columns.insert(_columns.end(), other._columns.begin(), other._columns.end());
+    _weights.insert(_weights.end(), other._weights.begin(), other._weights.end());
+}
+
+/*
+* Builds the transposed (control point -> row) copy of the matrix used by add_column.
+* Must be called again after rows are pushed.
+*/
+void WeightMatrix::build_columns(int num_control_points) {
+    _column_offsets.assign(num_control_points + 1, 0);
+    _column_rows.resize(_columns.size());
+    _column_weights.resize(_weights.size());
+
+    // Count each column, then turn the counts into offsets:
+    for (int column : _columns) {
+        _column_offsets[column + 1]++;
+    }
+    for (int c = 0; c < num_control_points; c++) {
+        _column_offsets[c + 1] += _column_offsets[c];
+    }
+
+    // Scatter. Rows are visited in order so each column stays sorted by row.
+    pvector<int> cursor(_column_offsets.begin(), _column_offsets.end() - 1);
+    for (size_t row = 0; row < get_num_rows(); row++) {
+        for (int i = _row_offsets[row]; i < _row_offsets[row + 1]; i++) {
+            int dest = cursor[_columns[i]]++;
+            _column_rows[dest] = (int)row;
+            _column_weights[dest] = _weights[i];
+        }
+    }
+}
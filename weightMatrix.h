@@ -0,0 +1,52 @@
+#ifndef WEIGHT_MATRIX_H
+#define WEIGHT_MATRIX_H
+
+#include "lpoint3.h"
+#include "lvecBase4.h"
+#include "pvector.h"
+
+/*
+* Compact sparse (vertex x control point) weight matrix stored in
+* compressed sparse row form. Each row holds the non-zero tensor-product
+* Bernstein weights of one vertex, so deforming it is a sparse dot product
+* against the current control point positions.
+*/
+class WeightMatrix {
+public:
+    inline WeightMatrix();
+
+    inline void clear();
+    inline void reserve(size_t num_rows, size_t num_weights);
+
+    inline void begin_row();
+    inline void push_weight(int control_point, float weight);
+    void append(const WeightMatrix& other);
+    void build_columns(int num_control_points);
+
+    inline size_t get_num_rows() const;
+    inline size_t get_num_weights() const;
+
+    inline int get_row_begin(size_t row) const;
+    inline int get_row_end(size_t row) const;
+    inline int get_column(int i) const;
+    inline float get_weight(int i) const;
+
+    inline LPoint3f transform_row(size_t row, const LVecBase4f* control_points) const;
+    inline void add_column(int control_point, const LVecBase3f& delta, LPoint3f* positions) const;
+
+private:
+    // Row r spans [_row_offsets[r], _row_offsets[r + 1]) of _columns and _weights.
+    pvector<int> _row_offsets;
+    pvector<int> _columns;
+    pvector<float> _weights;
+
+    // Transposed copy (control point -> [row, weight]) for delta updates.
+    // Column c spans [_column_offsets[c], _column_offsets[c + 1]).
+    pvector<int> _column_offsets;
+    pvector<int> _column_rows;
+    pvector<float> _column_weights;
+};
+
+#include "weightMatrix.I"
+
+#endif